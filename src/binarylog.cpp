@@ -0,0 +1,306 @@
+#include "binarylog.h"
+#include <algorithm>
+#include <cstring>
+
+static const char LOG_FILE_MAGIC[4] = {'C', 'G', 'L', 'G'};
+static const char LOG_BLOCK_MAGIC[4] = {'C', 'G', 'L', 'B'};
+static const char LOG_INDEX_MAGIC[4] = {'C', 'G', 'L', 'I'};
+constexpr uint32_t LOG_VERSION = 1;
+
+static_assert(sizeof(LogFileHeader) == 32, "LogFileHeader must not be padded");
+static_assert(sizeof(LogBlockHeader) == 24, "LogBlockHeader must not be padded");
+static_assert(sizeof(LogIndexEntry) == 24, "LogIndexEntry must not be padded");
+static_assert(sizeof(LogFileFooter) == 16, "LogFileFooter must not be padded");
+static_assert(sizeof(LogStats) == 36, "LogStats must not be padded");
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Byte offsets of the columns of a block, relative to its start
+struct BlockLayout {
+    size_t iColors;
+    size_t iRegions;
+    size_t iStats;
+    size_t iSize;
+};
+
+static BlockLayout getBlockLayout(uint32_t count, uint32_t deltaBytes, bool withStats) {
+    BlockLayout layout;
+    layout.iColors = alignUp(sizeof(LogBlockHeader) + deltaBytes, 4);
+    layout.iRegions = alignUp(layout.iColors + 3 * (size_t)count, 2);
+    layout.iStats = alignUp(layout.iRegions + 2 * (size_t)count, 4);
+    layout.iSize = layout.iStats + (withStats ? sizeof(LogStats) * count : 0);
+    return layout;
+}
+
+// Reads the header of the block at offset and tells whether the whole block lies within the first end bytes
+static bool readBlockHeader(const uint8_t* data, uint64_t offset, uint64_t end, bool withStats, LogBlockHeader& header) {
+    if (offset < sizeof(LogFileHeader) || offset > end || end - offset < sizeof(LogBlockHeader)) {
+        return false;
+    }
+    memcpy(&header, data + offset, sizeof(header));
+    return memcmp(header.aMagic, LOG_BLOCK_MAGIC, sizeof(header.aMagic)) == 0 && header.iBlockSize >= sizeof(header) &&
+           header.iBlockSize <= end - offset && getBlockLayout(header.iCount, header.iDeltaBytes, withStats).iSize == header.iBlockSize;
+}
+
+LogStats getLogStats(const FrameStats& stats) {
+    LogStats logStats = {};
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+        logStats.aMean[c] = (float)stats.Mean(c);
+        logStats.aVariance[c] = (float)stats.Variance(c);
+        logStats.aMin[c] = stats.csChannels[c].iMin;
+        logStats.aMax[c] = stats.csChannels[c].iMax;
+    }
+    logStats.fMeanSquareError = (float)stats.MeanSquareError();
+    return logStats;
+}
+
+//--------------------------------------------------------------------------------------------
+// BinaryLogWriter implementation
+//--------------------------------------------------------------------------------------------
+std::shared_ptr<BinaryLogWriter> BinaryLogWriter::Create(const std::string& path, bool withStats, uint32_t blockCapacity) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return nullptr;
+    }
+    return std::shared_ptr<BinaryLogWriter>(new BinaryLogWriter(file, withStats, blockCapacity));
+}
+
+#ifdef _WIN32
+std::shared_ptr<BinaryLogWriter> BinaryLogWriter::Create(const std::wstring& path, bool withStats, uint32_t blockCapacity) {
+    FILE* file = _wfopen(path.c_str(), L"wb");
+    if (!file) {
+        return nullptr;
+    }
+    return std::shared_ptr<BinaryLogWriter>(new BinaryLogWriter(file, withStats, blockCapacity));
+}
+#endif
+
+BinaryLogWriter::BinaryLogWriter(FILE* file, bool withStats, uint32_t blockCapacity)
+    : pFile(file)
+    , bWithStats(withStats)
+    , iBlockCapacity((std::max)(blockCapacity, 1u))
+    , iOffset(0)
+    , bGood(true) {
+    LogFileHeader header = {};
+    memcpy(header.aMagic, LOG_FILE_MAGIC, sizeof(header.aMagic));
+    header.iVersion = LOG_VERSION;
+    header.iFlags = withStats ? LOG_FLAG_STATS : 0;
+    header.iBlockCapacity = iBlockCapacity;
+    Write(&header, sizeof(header));
+}
+
+BinaryLogWriter::~BinaryLogWriter() {
+    Close();
+}
+
+void BinaryLogWriter::Write(const void* data, size_t size) {
+    if (fwrite(data, 1, size, pFile) != size) {
+        bGood = false;
+    }
+    iOffset += size;
+}
+
+void BinaryLogWriter::Append(const CaptureItem& item) {
+    if (!pFile) {
+        return;
+    }
+    vTimestamps.push_back(item.iTimestamp);
+    vColors.push_back((uint8_t)(item.cAvgColor & 0xFF));
+    vColors.push_back((uint8_t)((item.cAvgColor >> 8) & 0xFF));
+    vColors.push_back((uint8_t)((item.cAvgColor >> 16) & 0xFF));
+    vRegions.push_back((uint16_t)item.iRegion);
+    if (bWithStats) {
+        vStats.push_back(getLogStats(item.fsStats));
+    }
+    if (vTimestamps.size() >= iBlockCapacity) {
+        WriteBlock();
+    }
+}
+
+void BinaryLogWriter::WriteBlock() {
+    if (vTimestamps.empty()) {
+        return;
+    }
+    const uint32_t count = (uint32_t)vTimestamps.size();
+    // Timestamp deltas, zigzag encoded so a clock going back still fits
+    vBlock.assign(sizeof(LogBlockHeader), 0);
+    for (uint32_t i = 1; i < count; i++) {
+        const int64_t delta = vTimestamps[i] - vTimestamps[i - 1];
+        uint64_t value = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        while (value >= 0x80) {
+            vBlock.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        vBlock.push_back((uint8_t)value);
+    }
+    const uint32_t deltaBytes = (uint32_t)(vBlock.size() - sizeof(LogBlockHeader));
+    const BlockLayout layout = getBlockLayout(count, deltaBytes, bWithStats);
+    vBlock.resize(layout.iSize, 0);
+    memcpy(&vBlock[layout.iColors], vColors.data(), vColors.size());
+    memcpy(&vBlock[layout.iRegions], vRegions.data(), vRegions.size() * sizeof(uint16_t));
+    if (bWithStats) {
+        memcpy(&vBlock[layout.iStats], vStats.data(), vStats.size() * sizeof(LogStats));
+    }
+    LogBlockHeader header;
+    memcpy(header.aMagic, LOG_BLOCK_MAGIC, sizeof(header.aMagic));
+    header.iCount = count;
+    header.iBaseTimestamp = vTimestamps[0];
+    header.iDeltaBytes = deltaBytes;
+    header.iBlockSize = (uint32_t)layout.iSize;
+    memcpy(vBlock.data(), &header, sizeof(header));
+
+    vIndex.push_back({iOffset, vTimestamps[0], count, 0});
+    Write(vBlock.data(), vBlock.size());
+    vTimestamps.clear();
+    vColors.clear();
+    vRegions.clear();
+    vStats.clear();
+}
+
+void BinaryLogWriter::Flush() {
+    if (!pFile) {
+        return;
+    }
+    WriteBlock();
+    if (fflush(pFile) != 0) {
+        bGood = false;
+    }
+}
+
+bool BinaryLogWriter::Close() {
+    if (!pFile) {
+        return bGood;
+    }
+    WriteBlock();
+    LogFileFooter footer;
+    footer.iIndexOffset = iOffset;
+    footer.iBlockCount = (uint32_t)vIndex.size();
+    memcpy(footer.aMagic, LOG_INDEX_MAGIC, sizeof(footer.aMagic));
+    Write(vIndex.data(), vIndex.size() * sizeof(LogIndexEntry));
+    Write(&footer, sizeof(footer));
+    if (fclose(pFile) != 0) {
+        bGood = false;
+    }
+    pFile = nullptr;
+    return bGood;
+}
+
+//--------------------------------------------------------------------------------------------
+// BinaryLogReader implementation
+//--------------------------------------------------------------------------------------------
+std::shared_ptr<BinaryLogReader> BinaryLogReader::Open(const std::string& path) {
+    auto file = MappedFile::Open(path);
+    if (!file || file->GetSize() < sizeof(LogFileHeader)) {
+        return nullptr;
+    }
+    std::shared_ptr<BinaryLogReader> reader(new BinaryLogReader(file));
+    const auto& header = reader->lfhHeader;
+    if (memcmp(header.aMagic, LOG_FILE_MAGIC, sizeof(header.aMagic)) != 0 || header.iVersion != LOG_VERSION) {
+        return nullptr;
+    }
+    reader->bComplete = reader->LoadIndex();
+    if (!reader->bComplete) {
+        reader->ScanBlocks();
+    }
+    for (const auto& block : reader->vIndex) {
+        reader->iEntryCount += block.iCount;
+    }
+    return reader;
+}
+
+BinaryLogReader::BinaryLogReader(std::shared_ptr<MappedFile> file)
+    : pFile(std::move(file))
+    , iEntryCount(0)
+    , bComplete(false) {
+    memcpy(&lfhHeader, pFile->GetData(), sizeof(lfhHeader));
+}
+
+bool BinaryLogReader::LoadIndex() {
+    const size_t size = pFile->GetSize();
+    if (size < sizeof(LogFileHeader) + sizeof(LogFileFooter)) {
+        return false;
+    }
+    LogFileFooter footer;
+    memcpy(&footer, pFile->GetData() + size - sizeof(footer), sizeof(footer));
+    const uint64_t indexSize = (uint64_t)footer.iBlockCount * sizeof(LogIndexEntry);
+    if (memcmp(footer.aMagic, LOG_INDEX_MAGIC, sizeof(footer.aMagic)) != 0 || footer.iIndexOffset < sizeof(LogFileHeader) ||
+        footer.iIndexOffset > size - sizeof(footer) || size - sizeof(footer) - footer.iIndexOffset != indexSize) {
+        return false;
+    }
+    vIndex.resize(footer.iBlockCount);
+    memcpy(vIndex.data(), pFile->GetData() + footer.iIndexOffset, indexSize);
+    // Every block must lie before the index and agree with its entry, or the blocks are walked instead
+    for (const auto& entry : vIndex) {
+        LogBlockHeader header;
+        if (!readBlockHeader(pFile->GetData(), entry.iOffset, footer.iIndexOffset, HasStats(), header) ||
+            header.iCount != entry.iCount) {
+            vIndex.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void BinaryLogReader::ScanBlocks() {
+    // Walks the blocks that were completely written, stopping at the first torn one
+    const size_t size = pFile->GetSize();
+    uint64_t offset = sizeof(LogFileHeader);
+    LogBlockHeader header;
+    while (readBlockHeader(pFile->GetData(), offset, size, HasStats(), header)) {
+        vIndex.push_back({offset, header.iBaseTimestamp, header.iCount, 0});
+        offset += header.iBlockSize;
+    }
+}
+
+bool BinaryLogReader::ReadBlock(size_t block, std::vector<LogEntry>& entries) const {
+    LogBlockHeader header;
+    if (!readBlockHeader(pFile->GetData(), vIndex[block].iOffset, pFile->GetSize(), HasStats(), header)) {
+        return false;
+    }
+    const uint8_t* data = pFile->GetData() + vIndex[block].iOffset;
+    const BlockLayout layout = getBlockLayout(header.iCount, header.iDeltaBytes, HasStats());
+    const size_t first = entries.size();
+    entries.resize(first + header.iCount);
+    const uint8_t* delta = data + sizeof(header);
+    const uint8_t* deltaEnd = delta + header.iDeltaBytes;
+    int64_t timestamp = header.iBaseTimestamp;
+    for (uint32_t i = 0; i < header.iCount; i++) {
+        auto& entry = entries[first + i];
+        if (i > 0) {
+            uint64_t value = 0;
+            int shift = 0;
+            uint8_t byte;
+            do {
+                if (delta == deltaEnd || shift > 63) {
+                    entries.resize(first);
+                    return false;
+                }
+                byte = *delta++;
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            timestamp += (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+        }
+        entry.iTimestamp = timestamp;
+        const uint8_t* color = data + layout.iColors + 3 * (size_t)i;
+        entry.cAvgColor = color[0] | (color[1] << 8) | (color[2] << 16);
+        uint16_t region;
+        memcpy(&region, data + layout.iRegions + 2 * (size_t)i, sizeof(region));
+        entry.iRegion = region;
+        if (HasStats()) {
+            memcpy(&entry.lsStats, data + layout.iStats + sizeof(LogStats) * i, sizeof(LogStats));
+        } else {
+            entry.lsStats = LogStats();
+        }
+    }
+    return true;
+}
+
+size_t BinaryLogReader::FindBlock(int64_t timestamp) const {
+    // Last block starting at or before timestamp, since its later entries may still be after it
+    auto it = std::upper_bound(vIndex.begin(), vIndex.end(), timestamp,
+                               [](int64_t value, const LogIndexEntry& block) { return value < block.iFirstTimestamp; });
+    return it == vIndex.begin() ? 0 : (size_t)(it - vIndex.begin()) - 1;
+}
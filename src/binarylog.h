@@ -0,0 +1,165 @@
+#ifndef __CAPGRAPH_BINARYLOG_H__
+#define __CAPGRAPH_BINARYLOG_H__
+#include "captureitem.h"
+#include "mappedfile.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Binary capture log. All values are little endian.
+//
+//   LogFileHeader
+//   Blocks, each one made of:
+//     LogBlockHeader
+//     Timestamps: iDeltaBytes of zigzag LEB128 differences to the previous timestamp (the first one is iBaseTimestamp)
+//     Colors: 3 bytes (R, G, B) per entry, starting at a 4 byte boundary
+//     Regions: uint16_t per entry, starting at a 2 byte boundary
+//     Statistics: LogStats per entry, starting at a 4 byte boundary, when LOG_FLAG_STATS is set
+//   Index: one LogIndexEntry per block
+//   LogFileFooter
+//
+// Files that were not closed have no index nor footer; their blocks are still read by walking them from the header.
+
+constexpr uint32_t LOG_FLAG_STATS = 1;
+constexpr uint32_t DEFAULT_LOG_BLOCK_CAPACITY = 4096;
+
+struct LogFileHeader {
+    char aMagic[4];
+    uint32_t iVersion;
+    uint32_t iFlags;
+    uint32_t iBlockCapacity;
+    uint64_t aReserved[2];
+};
+
+struct LogBlockHeader {
+    char aMagic[4];
+    uint32_t iCount;
+    int64_t iBaseTimestamp;
+    uint32_t iDeltaBytes;
+    // Size of the whole block, header included
+    uint32_t iBlockSize;
+};
+
+struct LogIndexEntry {
+    uint64_t iOffset;
+    int64_t iFirstTimestamp;
+    uint32_t iCount;
+    uint32_t iReserved;
+};
+
+struct LogFileFooter {
+    uint64_t iIndexOffset;
+    uint32_t iBlockCount;
+    char aMagic[4];
+};
+
+// Summary of the frame statistics kept per entry
+struct LogStats {
+    float aMean[3];
+    float aVariance[3];
+    uint8_t aMin[3];
+    uint8_t aMax[3];
+    uint16_t iReserved;
+    float fMeanSquareError;
+};
+
+struct LogEntry {
+    int64_t iTimestamp;
+    uint32_t cAvgColor;
+    uint32_t iRegion;
+    LogStats lsStats;
+};
+
+LogStats getLogStats(const FrameStats& stats);
+
+class BinaryLogWriter {
+public:
+    // Returns null when the file can't be created
+    static std::shared_ptr<BinaryLogWriter> Create(const std::string& path, bool withStats,
+                                                   uint32_t blockCapacity = DEFAULT_LOG_BLOCK_CAPACITY);
+#ifdef _WIN32
+    static std::shared_ptr<BinaryLogWriter> Create(const std::wstring& path, bool withStats,
+                                                   uint32_t blockCapacity = DEFAULT_LOG_BLOCK_CAPACITY);
+#endif
+    // Closes the log
+    ~BinaryLogWriter();
+
+    void Append(const CaptureItem& item);
+    // Writes the pending entries as a (possibly short) block, so they survive a crash
+    void Flush();
+    // Writes the pending entries, the index and the footer. Nothing can be appended afterwards.
+    bool Close();
+
+    // False once a write failed
+    bool IsGood() const {
+        return bGood;
+    }
+
+private:
+    BinaryLogWriter(FILE* file, bool withStats, uint32_t blockCapacity);
+    BinaryLogWriter(const BinaryLogWriter&) = delete;
+    BinaryLogWriter& operator=(const BinaryLogWriter&) = delete;
+
+    void Write(const void* data, size_t size);
+    void WriteBlock();
+
+    FILE* pFile;
+    bool bWithStats;
+    uint32_t iBlockCapacity;
+    uint64_t iOffset;
+    bool bGood;
+    // Columns of the block being filled
+    std::vector<int64_t> vTimestamps;
+    std::vector<uint8_t> vColors;
+    std::vector<uint16_t> vRegions;
+    std::vector<LogStats> vStats;
+    std::vector<uint8_t> vBlock;
+    std::vector<LogIndexEntry> vIndex;
+};
+
+// Reads a binary log through a memory mapping; blocks are decoded on demand
+class BinaryLogReader {
+public:
+    // Returns null when the file can't be mapped or is not a binary log
+    static std::shared_ptr<BinaryLogReader> Open(const std::string& path);
+
+    bool HasStats() const {
+        return (lfhHeader.iFlags & LOG_FLAG_STATS) != 0;
+    }
+    size_t GetBlockCount() const {
+        return vIndex.size();
+    }
+    const LogIndexEntry& GetBlockInfo(size_t block) const {
+        return vIndex[block];
+    }
+    uint64_t GetEntryCount() const {
+        return iEntryCount;
+    }
+    // True when the file has its index, i.e. it was closed properly
+    bool IsComplete() const {
+        return bComplete;
+    }
+
+    // Appends the entries of a block to entries. Returns false, appending nothing, when the block is corrupt.
+    bool ReadBlock(size_t block, std::vector<LogEntry>& entries) const;
+    // First block that may hold entries at or after timestamp, assuming the entries were logged in order
+    size_t FindBlock(int64_t timestamp) const;
+
+private:
+    BinaryLogReader(std::shared_ptr<MappedFile> file);
+    BinaryLogReader(const BinaryLogReader&) = delete;
+    BinaryLogReader& operator=(const BinaryLogReader&) = delete;
+
+    bool LoadIndex();
+    void ScanBlocks();
+
+    std::shared_ptr<MappedFile> pFile;
+    LogFileHeader lfhHeader;
+    std::vector<LogIndexEntry> vIndex;
+    uint64_t iEntryCount;
+    bool bComplete;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "captureformat.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <ctime>
+
+const uint8_t utf8BOM[] = {0xEF, 0xBB, 0xBF};
+
+static std::tm convertLocalTime(time_t unixTime) {
+    std::tm localTime = {};
+#ifdef _WIN32
+    localtime_s(&localTime, &unixTime);
+#else
+    localtime_r(&unixTime, &localTime);
+#endif
+    return localTime;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static int64_t getDaysFromCivil(int64_t year, int month, int day) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yearOfEra = year - era * 400;
+    const int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Offset of a local time to UTC, in seconds
+static int64_t getUtcOffset(time_t unixTime, const std::tm& localTime) {
+    const int64_t days = getDaysFromCivil(localTime.tm_year + 1900ll, localTime.tm_mon + 1, localTime.tm_mday);
+    return days * 86400 + localTime.tm_hour * 3600 + localTime.tm_min * 60 + localTime.tm_sec - (int64_t)unixTime;
+}
+
+// Date and time fields of a local time given as seconds since 1970-01-01
+static std::tm getCivilTime(int64_t localSeconds) {
+    int64_t days = localSeconds / 86400;
+    int64_t seconds = localSeconds % 86400;
+    if (seconds < 0) {
+        seconds += 86400;
+        days--;
+    }
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int64_t dayOfEra = days - era * 146097;
+    const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+    std::tm localTime = {};
+    localTime.tm_mday = (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    localTime.tm_mon = (int)(monthIndex < 10 ? monthIndex + 2 : monthIndex - 10);
+    localTime.tm_year = (int)(yearOfEra + era * 400 + (localTime.tm_mon < 2) - 1900);
+    localTime.tm_hour = (int)(seconds / 3600);
+    localTime.tm_min = (int)(seconds / 60 % 60);
+    localTime.tm_sec = (int)(seconds % 60);
+    return localTime;
+}
+
+// Converting a timestamp through the time zone rules is far slower than formatting it, and the items shown or exported
+// together are close in time. The UTC offset is cached per hour, as long as it's the same at both ends of the hour;
+// otherwise the hour holds a time zone transition and every conversion goes through the system.
+static std::tm getLocalTime(int64_t fileTime) {
+    struct OffsetCache {
+        int64_t iHour = INT64_MIN;
+        int64_t iOffset = 0;
+        bool bValid = false;
+    };
+    thread_local OffsetCache cache;
+    const int64_t unixTime = (fileTime - FILE_TIME_UNIX_EPOCH) / FILE_TIME_TO_SECONDS;
+    const int64_t hour = (unixTime >= 0 ? unixTime : unixTime - 3599) / 3600;
+    if (hour != cache.iHour) {
+        const time_t hourStart = (time_t)(hour * 3600);
+        const time_t hourEnd = hourStart + 3599;
+        const int64_t startOffset = getUtcOffset(hourStart, convertLocalTime(hourStart));
+        cache.iHour = hour;
+        cache.iOffset = startOffset;
+        cache.bValid = getUtcOffset(hourEnd, convertLocalTime(hourEnd)) == startOffset;
+    }
+    if (!cache.bValid) {
+        return convertLocalTime((time_t)unixTime);
+    }
+    return getCivilTime(unixTime + cache.iOffset);
+}
+
+int64_t getCurrentFileTime() {
+    const auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+    // FILETIME counts 100 ns intervals
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count() / 100 + FILE_TIME_UNIX_EPOCH;
+}
+
+// Decimal value, padded with zeros to width the way std::setw and std::setfill('0') do
+template <typename CharT>
+static CharT* writeDecimal(CharT* buffer, int64_t value, int width = 0) {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    for (int i = (int)(result.ptr - digits); i < width; i++) {
+        *buffer++ = '0';
+    }
+    for (const char* digit = digits; digit != result.ptr; digit++) {
+        *buffer++ = (CharT)*digit;
+    }
+    return buffer;
+}
+
+template <typename CharT>
+static CharT* writeHexadecimal(CharT* buffer, uint32_t value, int width) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    int length = 1;
+    while (length < 8 && (value >> (4 * length)) != 0) {
+        length++;
+    }
+    for (int i = length; i < width; i++) {
+        *buffer++ = '0';
+    }
+    for (int i = length - 1; i >= 0; i--) {
+        *buffer++ = (CharT)hexDigits[(value >> (4 * i)) & 0xF];
+    }
+    return buffer;
+}
+
+template <typename CharT>
+static CharT* writeTimestamp(const CaptureItem& item, CharT* buffer) {
+    const std::tm localTime = getLocalTime(item.iTimestamp);
+    buffer = writeDecimal(buffer, localTime.tm_year + 1900ll, 4);
+    *buffer++ = '-';
+    buffer = writeDecimal(buffer, localTime.tm_mon + 1, 2);
+    *buffer++ = '-';
+    buffer = writeDecimal(buffer, localTime.tm_mday, 2);
+    *buffer++ = ' ';
+    buffer = writeDecimal(buffer, localTime.tm_hour, 2);
+    *buffer++ = ':';
+    buffer = writeDecimal(buffer, localTime.tm_min, 2);
+    *buffer++ = ':';
+    return writeDecimal(buffer, localTime.tm_sec, 2);
+}
+
+// cAvgColor is a COLORREF (red in the low byte), written in the usual #RRGGBB order
+static inline uint32_t getWebColor(uint32_t color) {
+    return ((color & 0xFF) << 16) | (color & 0xFF00) | ((color >> 16) & 0xFF);
+}
+
+template <typename CharT>
+static CharT* writeColor(const CaptureItem& item, CharT* buffer) {
+    *buffer++ = '#';
+    return writeHexadecimal(buffer, getWebColor(item.cAvgColor), 6);
+}
+
+template <typename CharT>
+static CharT* writeItem(const CaptureItem& item, CharT* buffer) {
+    buffer = writeTimestamp(item, buffer);
+    *buffer++ = ' ';
+    *buffer++ = '-';
+    *buffer++ = ' ';
+    return writeHexadecimal(buffer, getWebColor(item.cAvgColor), 6);
+}
+
+char* formatCaptureItemTimestamp(const CaptureItem& item, char* buffer) {
+    return writeTimestamp(item, buffer);
+}
+
+wchar_t* formatCaptureItemTimestamp(const CaptureItem& item, wchar_t* buffer) {
+    return writeTimestamp(item, buffer);
+}
+
+char* formatCaptureItemColor(const CaptureItem& item, char* buffer) {
+    return writeColor(item, buffer);
+}
+
+wchar_t* formatCaptureItemColor(const CaptureItem& item, wchar_t* buffer) {
+    return writeColor(item, buffer);
+}
+
+char* formatCaptureItem(const CaptureItem& item, char* buffer) {
+    return writeItem(item, buffer);
+}
+
+wchar_t* formatCaptureItem(const CaptureItem& item, wchar_t* buffer) {
+    return writeItem(item, buffer);
+}
+
+char* formatCaptureLine(const CaptureItem& item, const char* delimiter, size_t delimiterLength, char* buffer) {
+    *buffer++ = '"';
+    buffer = writeTimestamp(item, buffer);
+    *buffer++ = '"';
+    buffer = std::copy(delimiter, delimiter + delimiterLength, buffer);
+    *buffer++ = '"';
+    buffer = writeColor(item, buffer);
+    *buffer++ = '"';
+    buffer = std::copy(delimiter, delimiter + delimiterLength, buffer);
+    buffer = writeDecimal(buffer, item.cAvgColor & 0xFF);
+    buffer = std::copy(delimiter, delimiter + delimiterLength, buffer);
+    buffer = writeDecimal(buffer, (item.cAvgColor >> 8) & 0xFF);
+    buffer = std::copy(delimiter, delimiter + delimiterLength, buffer);
+    buffer = writeDecimal(buffer, (item.cAvgColor >> 16) & 0xFF);
+    *buffer++ = '\n';
+    return buffer;
+}
+
+std::string formatCaptureItemTimestamp(const CaptureItem& item) {
+    char buffer[CAPTURE_TIMESTAMP_MAX_LENGTH];
+    return std::string(buffer, formatCaptureItemTimestamp(item, buffer));
+}
+
+std::string formatCaptureItemColor(const CaptureItem& item) {
+    char buffer[CAPTURE_COLOR_MAX_LENGTH];
+    return std::string(buffer, formatCaptureItemColor(item, buffer));
+}
+
+std::string formatCaptureItem(const CaptureItem& item) {
+    char buffer[CAPTURE_ITEM_MAX_LENGTH];
+    return std::string(buffer, formatCaptureItem(item, buffer));
+}
+
+std::string formatCaptureHeader(const std::string& delimiter) {
+    std::string header((const char*)utf8BOM, 3);
+    header += "Timestamp" + delimiter + "Cor" + delimiter + "R" + delimiter + "G" + delimiter + "B\n";
+    return header;
+}
+
+std::string formatCaptureLine(const CaptureItem& item, const std::string& delimiter) {
+    std::string line(getCaptureLineMaxLength(delimiter.size()), '\0');
+    line.resize(formatCaptureLine(item, delimiter.data(), delimiter.size(), &line[0]) - line.data());
+    return line;
+}
+
+void writeCaptureHeader(std::ostream& file, const std::string& delimiter) {
+    file << formatCaptureHeader(delimiter);
+}
+
+void writeCaptureLine(std::ostream& file, const CaptureItem& item, const std::string& delimiter) {
+    char buffer[getCaptureLineMaxLength(16)];
+    if (delimiter.size() > 16) {
+        file << formatCaptureLine(item, delimiter);
+        return;
+    }
+    file.write(buffer, formatCaptureLine(item, delimiter.data(), delimiter.size(), buffer) - buffer);
+}
+
+void writeLogEntryJson(std::ostream& file, const LogEntry& entry, bool withStats) {
+    CaptureItem item = {};
+    item.iTimestamp = entry.iTimestamp;
+    item.cAvgColor = entry.cAvgColor;
+    char timestamp[CAPTURE_TIMESTAMP_MAX_LENGTH];
+    file << "{\"timestamp\":\"";
+    file.write(timestamp, formatCaptureItemTimestamp(item, timestamp) - timestamp);
+    file << "\",\"filetime\":" << entry.iTimestamp << ",\"region\":" << entry.iRegion << ",\"r\":" << (entry.cAvgColor & 0xFF)
+         << ",\"g\":" << ((entry.cAvgColor >> 8) & 0xFF) << ",\"b\":" << ((entry.cAvgColor >> 16) & 0xFF);
+    if (withStats) {
+        const auto& stats = entry.lsStats;
+        file << ",\"mean\":[" << stats.aMean[0] << "," << stats.aMean[1] << "," << stats.aMean[2] << "],\"variance\":["
+             << stats.aVariance[0] << "," << stats.aVariance[1] << "," << stats.aVariance[2] << "],\"min\":[" << (int)stats.aMin[0]
+             << "," << (int)stats.aMin[1] << "," << (int)stats.aMin[2] << "],\"max\":[" << (int)stats.aMax[0] << ","
+             << (int)stats.aMax[1] << "," << (int)stats.aMax[2] << "],\"mse\":" << stats.fMeanSquareError;
+    }
+    file << "}";
+}
@@ -0,0 +1,55 @@
+#ifndef __CAPGRAPH_CAPTUREFORMAT_H__
+#define __CAPGRAPH_CAPTUREFORMAT_H__
+#include "binarylog.h"
+#include "captureitem.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// FILETIME ticks between 1601-01-01 and the Unix epoch
+constexpr int64_t FILE_TIME_UNIX_EPOCH = 116444736000000000ll;
+constexpr int64_t FILE_TIME_TO_SECONDS = 10000000ll;
+
+// Current UTC time in FILETIME ticks
+int64_t getCurrentFileTime();
+
+// Buffer sizes for the formatters below, in characters. A timestamp may only be longer for years past 9999.
+constexpr size_t CAPTURE_TIMESTAMP_MAX_LENGTH = 32;
+constexpr size_t CAPTURE_COLOR_MAX_LENGTH = 9;
+constexpr size_t CAPTURE_ITEM_MAX_LENGTH = CAPTURE_TIMESTAMP_MAX_LENGTH + 3 + CAPTURE_COLOR_MAX_LENGTH - 1;
+constexpr size_t getCaptureLineMaxLength(size_t delimiterLength) {
+    return CAPTURE_TIMESTAMP_MAX_LENGTH + CAPTURE_COLOR_MAX_LENGTH + 14 + 4 * delimiterLength;
+}
+
+// Formatters writing into a caller supplied buffer, without allocating nor null terminating it.
+// They return the end of the written text. The char versions write UTF-8 and the wchar_t versions UTF-16,
+// with the same characters as the std::string versions.
+char* formatCaptureItemTimestamp(const CaptureItem& item, char* buffer);
+wchar_t* formatCaptureItemTimestamp(const CaptureItem& item, wchar_t* buffer);
+char* formatCaptureItemColor(const CaptureItem& item, char* buffer);
+wchar_t* formatCaptureItemColor(const CaptureItem& item, wchar_t* buffer);
+char* formatCaptureItem(const CaptureItem& item, char* buffer);
+wchar_t* formatCaptureItem(const CaptureItem& item, wchar_t* buffer);
+// buffer must hold getCaptureLineMaxLength(delimiterLength) characters
+char* formatCaptureLine(const CaptureItem& item, const char* delimiter, size_t delimiterLength, char* buffer);
+
+// "YYYY-MM-DD hh:mm:ss" in local time
+std::string formatCaptureItemTimestamp(const CaptureItem& item);
+// Web color of the average, "#RRGGBB" in hexadecimal
+std::string formatCaptureItemColor(const CaptureItem& item);
+// Timestamp and color, as shown in the status bar
+std::string formatCaptureItem(const CaptureItem& item);
+
+// UTF-8 BOM and header line of a capture CSV file
+std::string formatCaptureHeader(const std::string& delimiter);
+// CSV line of an item: quoted timestamp and color, then the R, G and B values
+std::string formatCaptureLine(const CaptureItem& item, const std::string& delimiter);
+
+// Same as above, written to a stream. Lines end with '\n' and don't flush the stream.
+void writeCaptureHeader(std::ostream& file, const std::string& delimiter);
+void writeCaptureLine(std::ostream& file, const CaptureItem& item, const std::string& delimiter);
+// JSON object of a log entry, with its statistics when withStats is set, without a separator nor a line end
+void writeLogEntryJson(std::ostream& file, const LogEntry& entry, bool withStats);
+
+#endif
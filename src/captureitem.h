@@ -0,0 +1,24 @@
+#ifndef __CAPGRAPH_CAPTUREITEM_H__
+#define __CAPGRAPH_CAPTUREITEM_H__
+#include "framekernels.h"
+#include "stillnesstracker.h"
+#include <cstdint>
+
+struct CaptureItem {
+    // UTC time in 100 ns ticks since 1601 (FILETIME), shown in local time
+    int64_t iTimestamp;
+    // Average color in COLORREF layout (0x00BBGGRR)
+    uint32_t cAvgColor;
+    FrameStats fsStats;
+    // Id of the region that recorded the item
+    uint32_t iRegion;
+};
+
+// Result of processing a frame, sent from the capture worker to the UI thread
+struct CaptureEvent {
+    StillnessEvent seType;
+    CaptureItem ciItem;
+    double dDiff;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "captureitemmodel.h"
+#include <algorithm>
+#include <cstdio>
+
+constexpr size_t NO_CACHED_BLOCK = (size_t)-1;
+// Expired rows past a full segment beyond which Append waits for the segment being written, which bounds memory when
+// rows come faster than segments can be written
+constexpr size_t SPILL_BACKLOG_ROWS = 4 * CaptureItemModel::SEGMENT_ROWS;
+
+// Columns of a chunk of rows being written to a segment
+struct SpillChunk {
+    const int64_t* pTimestamps;
+    const uint32_t* pColors;
+    const uint16_t* pRegions;
+};
+
+// Writes rows to a new segment file and opens it for reading. Returns null when that fails.
+static std::shared_ptr<BinaryLogReader> writeSegment(const std::filesystem::path& path, const std::vector<SpillChunk>& chunks) {
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    auto writer = BinaryLogWriter::Create(path.native(), false);
+    if (!writer) {
+        return nullptr;
+    }
+    for (const auto& chunk : chunks) {
+        for (size_t i = 0; i < ChunkedArray<int64_t>::CHUNK_SIZE; i++) {
+            CaptureItem item = {};
+            item.iTimestamp = chunk.pTimestamps[i];
+            item.cAvgColor = chunk.pColors[i];
+            item.iRegion = chunk.pRegions[i];
+            writer->Append(item);
+        }
+    }
+    if (!writer->Close()) {
+        return nullptr;
+    }
+    writer.reset();
+    return BinaryLogReader::Open(path.u8string());
+}
+
+CaptureItemModel::CaptureItemModel()
+    : iSpilledRows(0)
+    , iSegmentSerial(0)
+    , bSpillFailed(false)
+    , iCachedSegment(NO_CACHED_BLOCK)
+    , iCachedBlock(NO_CACHED_BLOCK)
+    , bSpillDone(false)
+    , iPendingRows(0) {
+}
+
+CaptureItemModel::~CaptureItemModel() {
+    FinishSpill(true);
+    RemoveSegments();
+    // Only removed when nothing else was left in it
+    if (!pSegmentDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::remove(pSegmentDirectory, error);
+    }
+}
+
+void CaptureItemModel::SetRetention(const RetentionPolicy& policy, const std::filesystem::path& directory) {
+    rpPolicy = policy;
+    pSegmentDirectory = directory;
+    bSpillFailed = false;
+}
+
+CaptureItem CaptureItemModel::GetItem(size_t index) const {
+    const CaptureRow row = GetRow(index);
+    CaptureItem item = {};
+    item.iTimestamp = row.iTimestamp;
+    item.cAvgColor = row.cAvgColor;
+    item.iRegion = row.iRegion;
+    return item;
+}
+
+void CaptureItemModel::Append(const CaptureItem& item) {
+    caTimestamps.push_back(item.iTimestamp);
+    caColors.push_back(item.cAvgColor);
+    caRegions.push_back((uint16_t)item.iRegion);
+    // Only checked as each chunk fills, so rows are appended at the same cost with a retention policy
+    if (pSegmentDirectory.empty() || (caTimestamps.size() & ChunkedArray<int64_t>::CHUNK_MASK) != 0) {
+        return;
+    }
+    FinishSpill(GetExpiredRowCount() >= SEGMENT_ROWS + SPILL_BACKLOG_ROWS);
+    if (!tSpill.joinable() && !bSpillFailed && GetExpiredRowCount() >= SEGMENT_ROWS) {
+        StartSpill(SEGMENT_ROWS);
+    }
+}
+
+void CaptureItemModel::Clear() {
+    FinishSpill(true);
+    caTimestamps.clear();
+    caColors.clear();
+    caRegions.clear();
+    RemoveSegments();
+    iSpilledRows = 0;
+    bSpillFailed = false;
+}
+
+size_t CaptureItemModel::GetExpiredRowCount() const {
+    constexpr size_t chunkSize = ChunkedArray<int64_t>::CHUNK_SIZE;
+    const size_t rowCount = caTimestamps.size();
+    size_t expired = rpPolicy.iMaxRows && rowCount > rpPolicy.iMaxRows ? rowCount - rpPolicy.iMaxRows : 0;
+    expired -= expired % chunkSize;
+    if (rpPolicy.iMaxAge && rowCount > 0) {
+        // Rows are appended in time order, so a chunk whose last row is too old is all expired
+        const int64_t cutoff = caTimestamps[rowCount - 1] - rpPolicy.iMaxAge;
+        while (expired + chunkSize <= rowCount && caTimestamps[expired + chunkSize - 1] < cutoff) {
+            expired += chunkSize;
+        }
+    }
+    return expired;
+}
+
+void CaptureItemModel::StartSpill(size_t count) {
+    char name[32];
+    snprintf(name, sizeof(name), "segment-%06llu.cglog", (unsigned long long)++iSegmentSerial);
+    sPendingSegment = Segment();
+    sPendingSegment.pPath = pSegmentDirectory / name;
+    sPendingSegment.iFirstRow = iSpilledRows;
+    iPendingRows = count;
+    // The thread reads the first chunks in place: nothing writes them, and they are only released by FinishSpill once it
+    // has joined the thread. Appending meanwhile may move the chunk pointers, so they are taken here.
+    std::vector<SpillChunk> chunks(count / ChunkedArray<int64_t>::CHUNK_SIZE);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        chunks[i] = {caTimestamps.chunk(i), caColors.chunk(i), caRegions.chunk(i)};
+    }
+    bSpillDone.store(false, std::memory_order_relaxed);
+    tSpill = std::thread([this, chunks = std::move(chunks)]() {
+        sPendingSegment.pReader = writeSegment(sPendingSegment.pPath, chunks);
+        bSpillDone.store(true, std::memory_order_release);
+    });
+}
+
+void CaptureItemModel::FinishSpill(bool wait) {
+    if (!tSpill.joinable() || (!wait && !bSpillDone.load(std::memory_order_acquire))) {
+        return;
+    }
+    tSpill.join();
+    Segment segment = std::move(sPendingSegment);
+    sPendingSegment = Segment();
+    if (!segment.pReader || segment.pReader->GetEntryCount() != iPendingRows) {
+        std::error_code error;
+        segment.pReader.reset();
+        std::filesystem::remove(segment.pPath, error);
+        bSpillFailed = true;
+        return;
+    }
+    size_t blockRow = 0;
+    for (size_t block = 0; block < segment.pReader->GetBlockCount(); block++) {
+        segment.vBlockRows.push_back(blockRow);
+        blockRow += segment.pReader->GetBlockInfo(block).iCount;
+    }
+    vSegments.push_back(std::move(segment));
+    const size_t chunkCount = iPendingRows / ChunkedArray<int64_t>::CHUNK_SIZE;
+    caTimestamps.erase_front_chunks(chunkCount);
+    caColors.erase_front_chunks(chunkCount);
+    caRegions.erase_front_chunks(chunkCount);
+    iSpilledRows += iPendingRows;
+}
+
+void CaptureItemModel::RemoveSegments() {
+    std::error_code error;
+    for (auto& segment : vSegments) {
+        // Unmapped first, since mapped files can't be removed everywhere
+        segment.pReader.reset();
+        std::filesystem::remove(segment.pPath, error);
+    }
+    vSegments.clear();
+    vCachedEntries.clear();
+    iCachedSegment = NO_CACHED_BLOCK;
+    iCachedBlock = NO_CACHED_BLOCK;
+}
+
+const LogEntry& CaptureItemModel::GetSpilledEntry(size_t index) const {
+    const auto segment = std::upper_bound(vSegments.begin(), vSegments.end(), index,
+                                          [](size_t row, const Segment& other) { return row < other.iFirstRow; }) -
+                         1;
+    const size_t row = index - segment->iFirstRow;
+    const size_t block =
+        std::upper_bound(segment->vBlockRows.begin(), segment->vBlockRows.end(), row) - segment->vBlockRows.begin() - 1;
+    const size_t segmentIndex = segment - vSegments.begin();
+    if (segmentIndex != iCachedSegment || block != iCachedBlock) {
+        vCachedEntries.clear();
+        if (!segment->pReader->ReadBlock(block, vCachedEntries)) {
+            // The segment was damaged since it was written; its rows read as empty
+            iCachedSegment = NO_CACHED_BLOCK;
+            static const LogEntry emptyEntry = LogEntry();
+            return emptyEntry;
+        }
+        iCachedSegment = segmentIndex;
+        iCachedBlock = block;
+    }
+    return vCachedEntries[row - segment->vBlockRows[block]];
+}
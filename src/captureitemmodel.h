@@ -0,0 +1,115 @@
+#ifndef __CAPGRAPH_CAPTUREITEMMODEL_H__
+#define __CAPGRAPH_CAPTUREITEMMODEL_H__
+#include "binarylog.h"
+#include "captureitem.h"
+#include "chunkedarray.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// What the item list keeps of a capture item. The frame statistics are left to the streaming logs.
+struct CaptureRow {
+    int64_t iTimestamp;
+    uint32_t cAvgColor;
+    uint32_t iRegion;
+};
+
+// Rows the item list keeps in memory. Rows past either limit are expired: they move to segment files once enough of
+// them have gathered, so memory stays flat however long the capture runs.
+struct RetentionPolicy {
+    // Most recent rows kept, 0 for no limit
+    size_t iMaxRows = 0;
+    // FILETIME ticks behind the newest row within which rows are kept, 0 for no limit
+    int64_t iMaxAge = 0;
+};
+
+// Indexable list of the recorded items, so a list view can format only the rows it shows.
+// Each field lives in its own chunked column: a row takes 14 bytes, times are kept as UTC ticks and only
+// converted to local time when formatted, and growing never copies the history.
+// With a retention policy, the oldest rows are written to immutable binary log segments and read back from there on
+// demand; they keep their indices, so readers don't notice where a row lives. Segments are written by a background
+// thread straight from the chunks of their rows, which stay in memory until the segment is complete, so Append only
+// waits on a file when rows expire faster than segments can be written.
+class CaptureItemModel {
+public:
+    // Expired rows are spilled in segments of this many rows, whole column chunks
+    static constexpr size_t SEGMENT_ROWS = ChunkedArray<int64_t>::CHUNK_SIZE * 16;
+
+    CaptureItemModel();
+    // Waits for the segment being written, then removes the segments
+    ~CaptureItemModel();
+    CaptureItemModel(const CaptureItemModel&) = delete;
+    CaptureItemModel& operator=(const CaptureItemModel&) = delete;
+
+    // Spills expired rows to segments in directory, created when needed, from the next appended row on. An empty
+    // directory keeps every row in memory.
+    void SetRetention(const RetentionPolicy& policy, const std::filesystem::path& directory);
+
+    size_t GetRowCount() const {
+        return iSpilledRows + caTimestamps.size();
+    }
+    bool IsEmpty() const {
+        return GetRowCount() == 0;
+    }
+    // Rows held in memory, the last ones
+    size_t GetResidentRowCount() const {
+        return caTimestamps.size();
+    }
+    CaptureRow GetRow(size_t index) const {
+        if (index >= iSpilledRows) {
+            index -= iSpilledRows;
+            return {caTimestamps[index], caColors[index], caRegions[index]};
+        }
+        const LogEntry& entry = GetSpilledEntry(index);
+        return {entry.iTimestamp, entry.cAvgColor, entry.iRegion};
+    }
+    // Item of a row, without statistics
+    CaptureItem GetItem(size_t index) const;
+
+    void Append(const CaptureItem& item);
+    // Removes every row, the segments included
+    void Clear();
+
+private:
+    struct Segment {
+        std::filesystem::path pPath;
+        std::shared_ptr<BinaryLogReader> pReader;
+        size_t iFirstRow;
+        // First row of each block, counted from iFirstRow
+        std::vector<size_t> vBlockRows;
+    };
+
+    ChunkedArray<int64_t> caTimestamps;
+    ChunkedArray<uint32_t> caColors;
+    ChunkedArray<uint16_t> caRegions;
+    RetentionPolicy rpPolicy;
+    std::filesystem::path pSegmentDirectory;
+    std::vector<Segment> vSegments;
+    size_t iSpilledRows;
+    uint64_t iSegmentSerial;
+    // Set when a segment couldn't be written; rows then stay in memory until the model is cleared
+    bool bSpillFailed;
+    // Last block read from a segment, so a list view scrolling through spilled rows decodes each block once
+    mutable size_t iCachedSegment;
+    mutable size_t iCachedBlock;
+    mutable std::vector<LogEntry> vCachedEntries;
+
+    // Segment being written by tSpill, swapped in by FinishSpill once bSpillDone is set
+    std::thread tSpill;
+    std::atomic<bool> bSpillDone;
+    Segment sPendingSegment;
+    size_t iPendingRows;
+
+    size_t GetExpiredRowCount() const;
+    void StartSpill(size_t count);
+    // Swaps in the segment written by the background thread, if it is done or wait is set
+    void FinishSpill(bool wait);
+    void RemoveSegments();
+    const LogEntry& GetSpilledEntry(size_t index) const;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "captureregion.h"
+
+std::shared_ptr<CaptureRegion> CaptureRegion::Create(uint32_t id, const std::wstring& name, const RECT& area) {
+    return std::shared_ptr<CaptureRegion>(new CaptureRegion(id, name, area));
+}
+
+CaptureRegion::CaptureRegion(uint32_t id, const std::wstring& name, const RECT& area)
+    : iId(id)
+    , sName(name)
+    , pSession(CaptureSession::Create(area))
+    , seEngine(id)
+    , bGrabbed(false)
+    , bHasEvent(false) {
+}
+
+void CaptureRegion::SetReferenceMode(ReferenceMode mode) {
+    // Only the frame reference reads the previous frame
+    const int bufferCount = mode == ReferenceMode::Frame ? 2 : 1;
+    if (pSession->GetBufferCount() != bufferCount) {
+        pSession = CaptureSession::Create(pSession->GetArea(), bufferCount);
+        bGrabbed = false;
+    }
+}
+
+bool CaptureRegion::Grab() {
+    bGrabbed = pSession->Grab();
+    return bGrabbed;
+}
+
+bool CaptureRegion::Analyze(int64_t now, const EngineSettings& settings) {
+    bHasEvent = false;
+    if (!bGrabbed) {
+        return false;
+    }
+    if (pRecorder) {
+        pRecorder->WriteFrame(pSession->GetFrame(), now);
+    }
+    bHasEvent = seEngine.ProcessFrame(pSession->GetFrame(), pSession->GetPreviousFrame(), pSession->GetWidth(), pSession->GetHeight(),
+                                      now, settings);
+    if (pPublisher && bHasEvent && seEngine.GetEvent().seType == StillnessEvent::StillImage) {
+        pPublisher->Publish(seEngine.GetEvent().ciItem);
+    }
+    if (pLog) {
+        if (bHasEvent && seEngine.GetEvent().seType == StillnessEvent::StillImage) {
+            pLog->Append(seEngine.GetEvent().ciItem);
+        } else {
+            pLog->FlushIfDue();
+        }
+    }
+    return bHasEvent;
+}
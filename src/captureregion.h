@@ -0,0 +1,82 @@
+#ifndef __CAPGRAPH_CAPTUREREGION_H__
+#define __CAPGRAPH_CAPTUREREGION_H__
+#include "captureitem.h"
+#include "capturesession.h"
+#include "csvwriter.h"
+#include "framefile.h"
+#include "sharedring.h"
+#include "stillnessengine.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <windows.h>
+
+// Named screen area watched for still images: its capture surfaces and the engine that analyses its frames.
+// Grab and Analyze are called from the capture worker; regions are only added or removed while it is stopped.
+class CaptureRegion {
+public:
+    static std::shared_ptr<CaptureRegion> Create(uint32_t id, const std::wstring& name, const RECT& area);
+
+    uint32_t GetId() const {
+        return iId;
+    }
+    const std::wstring& GetName() const {
+        return sName;
+    }
+    CaptureSession& GetSession() {
+        return *pSession;
+    }
+    // Recreates the capture surfaces with one or two buffers, as needed by the reference mode. Only while not capturing.
+    void SetReferenceMode(ReferenceMode mode);
+
+    StillnessEngine& GetEngine() {
+        return seEngine;
+    }
+    const StillnessEngine& GetEngine() const {
+        return seEngine;
+    }
+
+    // Saves every analysed frame to a compressed (version 2) frame recording, for offline replay. A null recorder stops the
+    // recording.
+    void SetRecorder(std::shared_ptr<FrameFileWriter> recorder) {
+        pRecorder = std::move(recorder);
+    }
+
+    // Appends every still image to a CSV log as it is recorded. A null log stops the logging.
+    void SetLog(std::shared_ptr<CaptureCsvWriter> log) {
+        pLog = std::move(log);
+    }
+
+    // Publishes every still image to a shared memory ring, which may be shared with other regions. A null ring stops it.
+    void SetPublisher(std::shared_ptr<SharedRingWriter> publisher) {
+        pPublisher = std::move(publisher);
+    }
+
+    bool Grab();
+    // Analyses the grabbed frame, taken at now (FILETIME ticks). Returns true when an event was produced, which is then
+    // available from GetEvent until the next call.
+    bool Analyze(int64_t now, const EngineSettings& settings);
+    bool HasEvent() const {
+        return bHasEvent;
+    }
+    const CaptureEvent& GetEvent() const {
+        return seEngine.GetEvent();
+    }
+
+private:
+    CaptureRegion(uint32_t id, const std::wstring& name, const RECT& area);
+    CaptureRegion(const CaptureRegion&) = delete;
+    CaptureRegion& operator=(const CaptureRegion&) = delete;
+
+    uint32_t iId;
+    std::wstring sName;
+    std::shared_ptr<CaptureSession> pSession;
+    std::shared_ptr<FrameFileWriter> pRecorder;
+    std::shared_ptr<CaptureCsvWriter> pLog;
+    std::shared_ptr<SharedRingWriter> pPublisher;
+    StillnessEngine seEngine;
+    bool bGrabbed;
+    bool bHasEvent;
+};
+
+#endif
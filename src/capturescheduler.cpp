@@ -0,0 +1,73 @@
+#include "capturescheduler.h"
+#include <algorithm>
+#include <cmath>
+
+// Weight of the newest tick in the moving averages
+constexpr double STATS_SMOOTHING = 0.1;
+// Margin added to the still deadline, since a still image is recorded only once the duration is strictly exceeded
+constexpr auto STILL_DEADLINE_MARGIN = std::chrono::milliseconds(1);
+
+static CaptureScheduler::Clock::duration rateToInterval(double rate) {
+    return std::chrono::duration_cast<CaptureScheduler::Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+}
+
+CaptureScheduler::CaptureScheduler(const SchedulerConfig& config) {
+    SetConfig(config);
+}
+
+void CaptureScheduler::SetConfig(const SchedulerConfig& config) {
+    scConfig = config;
+    scConfig.dCeilingRate = (std::max)(scConfig.dCeilingRate, 0.01);
+    scConfig.dFloorRate = (std::min)((std::max)(scConfig.dFloorRate, 0.01), scConfig.dCeilingRate);
+    scConfig.dBackoffFactor = (std::max)(scConfig.dBackoffFactor, 1.0);
+    dFastInterval = rateToInterval(scConfig.dCeilingRate);
+    dSlowInterval = rateToInterval(scConfig.dFloorRate);
+    Reset();
+}
+
+void CaptureScheduler::Reset() {
+    dCurrentInterval = dFastInterval;
+    tpLastStart = Clock::time_point();
+    std::lock_guard<std::mutex> lock(mStats);
+    ssStats = {0.0, 0.0, 0.0, 0};
+    dAverageIntervalMs = 0.0;
+}
+
+CaptureScheduler::Clock::duration CaptureScheduler::NextInterval(CaptureStatus status, Clock::duration stillRemaining) {
+    if (status == CaptureStatus::StillImage) {
+        auto next = std::chrono::duration_cast<Clock::duration>(dCurrentInterval * scConfig.dBackoffFactor);
+        dCurrentInterval = (std::min)(next, dSlowInterval);
+        return dCurrentInterval;
+    }
+    // Leaving the StillImage state restarts the backoff from the ceiling rate
+    dCurrentInterval = dFastInterval;
+    if (status == CaptureStatus::WaitingStillImage) {
+        return (std::min)(dFastInterval, (std::max)(stillRemaining, Clock::duration::zero()) + STILL_DEADLINE_MARGIN);
+    }
+    return dFastInterval;
+}
+
+void CaptureScheduler::RecordTick(Clock::time_point scheduled, Clock::time_point started) {
+    const double jitterMs = std::chrono::duration<double, std::milli>(started - scheduled).count();
+    const bool hasLast = tpLastStart != Clock::time_point();
+    const double intervalMs = hasLast ? std::chrono::duration<double, std::milli>(started - tpLastStart).count() : 0.0;
+    tpLastStart = started;
+    std::lock_guard<std::mutex> lock(mStats);
+    if (ssStats.iTickCount == 0) {
+        ssStats.dMeanJitterMs = std::fabs(jitterMs);
+    } else {
+        ssStats.dMeanJitterMs += STATS_SMOOTHING * (std::fabs(jitterMs) - ssStats.dMeanJitterMs);
+    }
+    ssStats.dMaxJitterMs = (std::max)(ssStats.dMaxJitterMs, std::fabs(jitterMs));
+    if (hasLast) {
+        dAverageIntervalMs = dAverageIntervalMs > 0.0 ? dAverageIntervalMs + STATS_SMOOTHING * (intervalMs - dAverageIntervalMs)
+                                                      : intervalMs;
+        ssStats.dEffectiveFps = dAverageIntervalMs > 0.0 ? 1000.0 / dAverageIntervalMs : 0.0;
+    }
+    ssStats.iTickCount++;
+}
+
+SchedulerStats CaptureScheduler::GetStats() const {
+    std::lock_guard<std::mutex> lock(mStats);
+    return ssStats;
+}
@@ -0,0 +1,58 @@
+#ifndef __CAPGRAPH_CAPTURESCHEDULER_H__
+#define __CAPGRAPH_CAPTURESCHEDULER_H__
+#include "capturestatus.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+struct SchedulerConfig {
+    // Lowest capture rate (frames per second), reached after a still image has been settled for a while
+    double dFloorRate = 2.0;
+    // Highest capture rate, used while waiting for the image to settle
+    double dCeilingRate = 20.0;
+    // Growth of the interval on each tick spent in the StillImage state
+    double dBackoffFactor = 1.25;
+};
+
+struct SchedulerStats {
+    // Capture rate actually achieved, averaged over the recent ticks
+    double dEffectiveFps;
+    // Average and worst delay between the planned and the actual start of a tick, in milliseconds
+    double dMeanJitterMs;
+    double dMaxJitterMs;
+    uint64_t iTickCount;
+};
+
+// Chooses the delay before the next capture tick from the state machine: backs off while a still image is settled and
+// samples at the ceiling rate while waiting for the image to settle. While waiting, the tick is also moved to the
+// instant the still duration expires, so still frames are recorded as soon as they qualify.
+class CaptureScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit CaptureScheduler(const SchedulerConfig& config = SchedulerConfig());
+
+    void SetConfig(const SchedulerConfig& config);
+    // Forgets the backoff state and the statistics
+    void Reset();
+
+    // stillRemaining is the time left before the current wait qualifies as a still image
+    Clock::duration NextInterval(CaptureStatus status, Clock::duration stillRemaining);
+    // Records the planned and the actual start of a tick
+    void RecordTick(Clock::time_point scheduled, Clock::time_point started);
+
+    // Safe to call from other threads
+    SchedulerStats GetStats() const;
+
+private:
+    SchedulerConfig scConfig;
+    Clock::duration dFastInterval;
+    Clock::duration dSlowInterval;
+    Clock::duration dCurrentInterval;
+    Clock::time_point tpLastStart;
+    mutable std::mutex mStats;
+    SchedulerStats ssStats;
+    double dAverageIntervalMs;
+};
+
+#endif
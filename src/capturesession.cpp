@@ -0,0 +1,79 @@
+#include "capturesession.h"
+
+std::shared_ptr<CaptureSession> CaptureSession::Create(const RECT& area, int bufferCount) {
+    return std::shared_ptr<CaptureSession>(new CaptureSession(area, bufferCount));
+}
+
+CaptureSession::CaptureSession(const RECT& area, int bufferCount)
+    : rArea(area)
+    , iBufferCount(bufferCount > 1 ? 2 : 1)
+    , iWidth(area.right - area.left)
+    , iHeight(area.bottom - area.top)
+    , hMemoryDc(NULL)
+    , hOriginalBitmap(NULL)
+    , hBitmaps{NULL, NULL}
+    , pPixels{nullptr, nullptr}
+    , iCurrent(0)
+    , iGrabCount(0) {
+    if (iWidth <= 0 || iHeight <= 0) {
+        return;
+    }
+    BITMAPINFO bmiInfo;
+    ZeroMemory(&bmiInfo, sizeof(bmiInfo));
+    bmiInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmiInfo.bmiHeader.biWidth = iWidth;
+    // Negative height makes the rows top-down
+    bmiInfo.bmiHeader.biHeight = -iHeight;
+    bmiInfo.bmiHeader.biPlanes = 1;
+    bmiInfo.bmiHeader.biBitCount = 32;
+    bmiInfo.bmiHeader.biCompression = BI_RGB;
+    hMemoryDc = CreateCompatibleDC(NULL);
+    for (int i = 0; i < iBufferCount; i++) {
+        void* bits = nullptr;
+        hBitmaps[i] = CreateDIBSection(hMemoryDc, &bmiInfo, DIB_RGB_COLORS, &bits, NULL, 0);
+        pPixels[i] = (uint32_t*)bits;
+    }
+    if (hMemoryDc && hBitmaps[0]) {
+        hOriginalBitmap = SelectObject(hMemoryDc, hBitmaps[0]);
+    }
+}
+
+CaptureSession::~CaptureSession() {
+    if (hMemoryDc && hOriginalBitmap) {
+        SelectObject(hMemoryDc, hOriginalBitmap);
+    }
+    for (auto bitmap : hBitmaps) {
+        if (bitmap) {
+            DeleteObject(bitmap);
+        }
+    }
+    if (hMemoryDc) {
+        DeleteDC(hMemoryDc);
+    }
+}
+
+bool CaptureSession::Grab() {
+    if (!IsValid()) {
+        return false;
+    }
+    const int back = iGrabCount > 0 && iBufferCount > 1 ? 1 - iCurrent : iCurrent;
+    SelectObject(hMemoryDc, hBitmaps[back]);
+    HDC screen = GetDC(NULL);
+    BOOL copied = BitBlt(hMemoryDc, 0, 0, iWidth, iHeight, screen, rArea.left, rArea.top, SRCCOPY);
+    ReleaseDC(NULL, screen);
+    // Makes sure GDI finished writing to the DIB before the pixels are read
+    GdiFlush();
+    if (!copied) {
+        SelectObject(hMemoryDc, hBitmaps[iCurrent]);
+        return false;
+    }
+    iCurrent = back;
+    iGrabCount++;
+    return true;
+}
+
+void CaptureSession::DrawPreview(HDC dc, int x, int y) const {
+    if (IsValid() && iGrabCount > 0) {
+        BitBlt(dc, x, y, iWidth, iHeight, hMemoryDc, 0, 0, SRCCOPY);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __CAPGRAPH_CAPTURESESSION_H__
+#define __CAPGRAPH_CAPTURESESSION_H__
+#include <cstdint>
+#include <memory>
+#include <windows.h>
+
+// Owns the GDI surfaces used to read a screen area. The frames are grabbed into two DIB sections that are used
+// alternately, so the previous frame stays available for comparison without copying or allocating per tick.
+// A single buffered session halves the memory when the previous frame is not needed.
+class CaptureSession {
+public:
+    // bufferCount is 1 or 2
+    static std::shared_ptr<CaptureSession> Create(const RECT& area, int bufferCount = 2);
+    ~CaptureSession();
+
+    // Copies the capture area from the screen into the back buffer, which then becomes the current frame
+    bool Grab();
+    // Draws the current frame on a device context
+    void DrawPreview(HDC dc, int x, int y) const;
+
+    bool IsValid() const {
+        return hMemoryDc && hBitmaps[0] && (iBufferCount == 1 || hBitmaps[1]);
+    }
+    int GetBufferCount() const {
+        return iBufferCount;
+    }
+    RECT GetArea() const {
+        return rArea;
+    }
+    int GetWidth() const {
+        return iWidth;
+    }
+    int GetHeight() const {
+        return iHeight;
+    }
+    size_t GetPixelCount() const {
+        return (size_t)iWidth * iHeight;
+    }
+    // Current frame, top-down rows of BGRA32 pixels as GetDIBits delivers them (null before the first grab)
+    const uint32_t* GetFrame() const {
+        return iGrabCount > 0 ? pPixels[iCurrent] : nullptr;
+    }
+    // Frame grabbed before the current one (null before the second grab, and always when single buffered)
+    const uint32_t* GetPreviousFrame() const {
+        return iBufferCount > 1 && iGrabCount > 1 ? pPixels[1 - iCurrent] : nullptr;
+    }
+
+private:
+    CaptureSession(const RECT& area, int bufferCount);
+    CaptureSession(const CaptureSession&) = delete;
+    CaptureSession& operator=(const CaptureSession&) = delete;
+
+    RECT rArea;
+    int iBufferCount;
+    int iWidth;
+    int iHeight;
+    HDC hMemoryDc;
+    HGDIOBJ hOriginalBitmap;
+    HBITMAP hBitmaps[2];
+    uint32_t* pPixels[2];
+    int iCurrent;
+    uint64_t iGrabCount;
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __CAPGRAPH_CAPTURESTATUS_H__
+#define __CAPGRAPH_CAPTURESTATUS_H__
+
+enum class CaptureStatus {
+    NotStarted,
+    WaitingStillImage,
+    StillImage,
+};
+
+#endif
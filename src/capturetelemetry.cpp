@@ -0,0 +1,207 @@
+#include "capturetelemetry.h"
+#include <algorithm>
+#include <cstdio>
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+constexpr CaptureTelemetry::Clock::duration CaptureTelemetry::DEFAULT_LATE_THRESHOLD;
+
+static const char* const captureStageNames[CAPTURE_STAGE_COUNT] = {"grab", "compare", "average", "transition",
+                                                                   "insert", "tick", "lateness"};
+
+const char* getCaptureStageName(CaptureStage stage) {
+    return captureStageNames[(int)stage];
+}
+
+// Index of the highest bit set; value must not be zero
+static int getHighestBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+static uint64_t getNanoseconds(CaptureTelemetry::Clock::duration duration) {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    return ns > 0 ? (uint64_t)ns : 0;
+}
+
+//--------------------------------------------------------------------------------------------
+// HistogramSnapshot implementation
+//--------------------------------------------------------------------------------------------
+double HistogramSnapshot::MeanNs() const {
+    return iCount ? (double)iSumNs / iCount : 0.0;
+}
+
+double HistogramSnapshot::PercentileNs(double fraction) const {
+    if (iCount == 0) {
+        return 0.0;
+    }
+    const uint64_t rank = (std::max)((uint64_t)1, (uint64_t)(fraction * iCount + 0.5));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; bucket++) {
+        seen += aCounts[bucket];
+        if (seen >= rank) {
+            return (double)(std::min)(LatencyHistogram::GetBucketLowerBound(bucket + 1), iMaxNs);
+        }
+    }
+    return (double)iMaxNs;
+}
+
+//--------------------------------------------------------------------------------------------
+// LatencyHistogram implementation
+//--------------------------------------------------------------------------------------------
+LatencyHistogram::LatencyHistogram() {
+    Reset();
+}
+
+int LatencyHistogram::GetBucket(uint64_t ns) {
+    if (ns < ((uint64_t)1 << HISTOGRAM_MIN_SHIFT)) {
+        return 0;
+    }
+    const int shift = getHighestBit(ns);
+    if (shift >= HISTOGRAM_MAX_SHIFT) {
+        return HISTOGRAM_BUCKET_COUNT - 1;
+    }
+    const int subBucket = (int)(ns >> (shift - HISTOGRAM_SUB_BUCKET_BITS)) & ((1 << HISTOGRAM_SUB_BUCKET_BITS) - 1);
+    return 1 + ((shift - HISTOGRAM_MIN_SHIFT) << HISTOGRAM_SUB_BUCKET_BITS) + subBucket;
+}
+
+uint64_t LatencyHistogram::GetBucketLowerBound(int bucket) {
+    if (bucket <= 0) {
+        return 0;
+    }
+    const int shift = HISTOGRAM_MIN_SHIFT + ((bucket - 1) >> HISTOGRAM_SUB_BUCKET_BITS);
+    const uint64_t subBucket = (uint64_t)((bucket - 1) & ((1 << HISTOGRAM_SUB_BUCKET_BITS) - 1));
+    return (((uint64_t)1 << HISTOGRAM_SUB_BUCKET_BITS) + subBucket) << (shift - HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+void LatencyHistogram::Record(uint64_t ns) {
+    aCounts[GetBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    iSumNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = iMaxNs.load(std::memory_order_relaxed);
+    while (ns > max && !iMaxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& count : aCounts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    iSumNs.store(0, std::memory_order_relaxed);
+    iMaxNs.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::GetSnapshot(HistogramSnapshot& snapshot) const {
+    // The total is taken from the buckets, so percentiles add up even when values are recorded meanwhile
+    snapshot.iCount = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; bucket++) {
+        snapshot.aCounts[bucket] = aCounts[bucket].load(std::memory_order_relaxed);
+        snapshot.iCount += snapshot.aCounts[bucket];
+    }
+    snapshot.iSumNs = iSumNs.load(std::memory_order_relaxed);
+    snapshot.iMaxNs = iMaxNs.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------------------
+// CaptureTelemetry implementation
+//--------------------------------------------------------------------------------------------
+CaptureTelemetry::CaptureTelemetry(Clock::duration lateThreshold)
+    : dLateThreshold(lateThreshold)
+    , iTickCount(0)
+    , iLateTicks(0)
+    , iMissedTicks(0) {
+}
+
+void CaptureTelemetry::Reset() {
+    for (auto& histogram : lhStages) {
+        histogram.Reset();
+    }
+    iTickCount.store(0, std::memory_order_relaxed);
+    iLateTicks.store(0, std::memory_order_relaxed);
+    iMissedTicks.store(0, std::memory_order_relaxed);
+}
+
+void CaptureTelemetry::Record(CaptureStage stage, Clock::duration latency) {
+    lhStages[(int)stage].Record(getNanoseconds(latency));
+}
+
+void CaptureTelemetry::RecordTick(Clock::time_point scheduled, Clock::time_point started, Clock::time_point finished,
+                                  uint64_t skippedTicks) {
+    Record(CaptureStage::Lateness, started - scheduled);
+    Record(CaptureStage::Tick, finished - started);
+    iTickCount.fetch_add(1, std::memory_order_relaxed);
+    if (started - scheduled > dLateThreshold) {
+        iLateTicks.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (skippedTicks) {
+        iMissedTicks.fetch_add(skippedTicks, std::memory_order_relaxed);
+    }
+}
+
+TelemetrySnapshot CaptureTelemetry::GetSnapshot() const {
+    TelemetrySnapshot snapshot;
+    for (int stage = 0; stage < CAPTURE_STAGE_COUNT; stage++) {
+        lhStages[stage].GetSnapshot(snapshot.hsStages[stage]);
+    }
+    snapshot.iTickCount = iTickCount.load(std::memory_order_relaxed);
+    snapshot.iLateTicks = iLateTicks.load(std::memory_order_relaxed);
+    snapshot.iMissedTicks = iMissedTicks.load(std::memory_order_relaxed);
+    snapshot.dLateThresholdMs = std::chrono::duration<double, std::milli>(dLateThreshold).count();
+    return snapshot;
+}
+
+//--------------------------------------------------------------------------------------------
+// Report
+//--------------------------------------------------------------------------------------------
+std::string formatTelemetryReport(const TelemetrySnapshot& snapshot, bool withHistograms) {
+    std::string report;
+    char line[256];
+    snprintf(line, sizeof(line), "ticks %llu, late (> %.1f ms) %llu, missed %llu\n\n", (unsigned long long)snapshot.iTickCount,
+             snapshot.dLateThresholdMs, (unsigned long long)snapshot.iLateTicks, (unsigned long long)snapshot.iMissedTicks);
+    report += line;
+    snprintf(line, sizeof(line), "%-11s %10s %10s %10s %10s %10s %10s\n", "stage (ms)", "count", "mean", "p50", "p90", "p99", "max");
+    report += line;
+    for (int stage = 0; stage < CAPTURE_STAGE_COUNT; stage++) {
+        const auto& histogram = snapshot.hsStages[stage];
+        snprintf(line, sizeof(line), "%-11s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n", captureStageNames[stage],
+                 (unsigned long long)histogram.iCount, histogram.MeanNs() / 1e6, histogram.PercentileNs(0.5) / 1e6,
+                 histogram.PercentileNs(0.9) / 1e6, histogram.PercentileNs(0.99) / 1e6, histogram.iMaxNs / 1e6);
+        report += line;
+    }
+    if (!withHistograms) {
+        return report;
+    }
+    report += "\nbucket_from_ms,bucket_to_ms";
+    for (int stage = 0; stage < CAPTURE_STAGE_COUNT; stage++) {
+        report += ",";
+        report += captureStageNames[stage];
+    }
+    report += "\n";
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; bucket++) {
+        bool used = false;
+        for (const auto& histogram : snapshot.hsStages) {
+            used = used || histogram.aCounts[bucket] != 0;
+        }
+        if (!used) {
+            continue;
+        }
+        snprintf(line, sizeof(line), "%.6f,%.6f", LatencyHistogram::GetBucketLowerBound(bucket) / 1e6,
+                 LatencyHistogram::GetBucketLowerBound(bucket + 1) / 1e6);
+        report += line;
+        for (const auto& histogram : snapshot.hsStages) {
+            snprintf(line, sizeof(line), ",%llu", (unsigned long long)histogram.aCounts[bucket]);
+            report += line;
+        }
+        report += "\n";
+    }
+    return report;
+}
+
+void writeTelemetryReport(std::ostream& file, const TelemetrySnapshot& snapshot, bool withHistograms) {
+    file << formatTelemetryReport(snapshot, withHistograms);
+}
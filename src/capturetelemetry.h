@@ -0,0 +1,115 @@
+#ifndef __CAPGRAPH_CAPTURETELEMETRY_H__
+#define __CAPGRAPH_CAPTURETELEMETRY_H__
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Stages of a capture tick whose latencies are measured
+enum class CaptureStage {
+    // Screen grab of a region
+    Grab,
+    // Tile hashing and frame comparison
+    Compare,
+    // Average and statistics of a still image
+    Average,
+    // State machine update
+    Transition,
+    // Insertion of a batch of items in the list, on the UI thread
+    Insert,
+    // Whole tick, from its start to the end of the capture
+    Tick,
+    // Delay between the planned and the actual start of a tick
+    Lateness,
+    Count,
+};
+
+constexpr int CAPTURE_STAGE_COUNT = (int)CaptureStage::Count;
+
+const char* getCaptureStageName(CaptureStage stage);
+
+// Bucket layout of the latency histograms: values under 2^MIN_SHIFT ns share the first bucket, then each power of two
+// is split in 2^SUB_BUCKET_BITS buckets up to 2^MAX_SHIFT ns (about 34 s), which also takes the longer values.
+// Percentiles are then known within 12.5%.
+constexpr int HISTOGRAM_MIN_SHIFT = 6;
+constexpr int HISTOGRAM_MAX_SHIFT = 35;
+constexpr int HISTOGRAM_SUB_BUCKET_BITS = 3;
+constexpr int HISTOGRAM_BUCKET_COUNT = 1 + ((HISTOGRAM_MAX_SHIFT - HISTOGRAM_MIN_SHIFT) << HISTOGRAM_SUB_BUCKET_BITS);
+
+// Copy of a histogram, consistent enough to be reported while it keeps being recorded
+struct HistogramSnapshot {
+    uint64_t aCounts[HISTOGRAM_BUCKET_COUNT];
+    uint64_t iCount;
+    uint64_t iSumNs;
+    uint64_t iMaxNs;
+
+    double MeanNs() const;
+    // Upper bound of the bucket holding the given fraction of the values, capped by the maximum
+    double PercentileNs(double fraction) const;
+};
+
+// Latency histogram with fixed log-scale buckets. Recording is lock free and may happen on several threads at once.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    static int GetBucket(uint64_t ns);
+    // Smallest value of a bucket, in ns (the bucket after the last one starts at 2^HISTOGRAM_MAX_SHIFT)
+    static uint64_t GetBucketLowerBound(int bucket);
+
+    void Record(uint64_t ns);
+    void Reset();
+    void GetSnapshot(HistogramSnapshot& snapshot) const;
+
+private:
+    std::atomic<uint64_t> aCounts[HISTOGRAM_BUCKET_COUNT];
+    std::atomic<uint64_t> iSumNs;
+    std::atomic<uint64_t> iMaxNs;
+};
+
+struct TelemetrySnapshot {
+    HistogramSnapshot hsStages[CAPTURE_STAGE_COUNT];
+    uint64_t iTickCount;
+    // Ticks that started later than the late threshold
+    uint64_t iLateTicks;
+    // Ticks skipped because the previous ones overran
+    uint64_t iMissedTicks;
+    double dLateThresholdMs;
+};
+
+// Latencies of the capture loop stages, with the late and missed tick counters. Safe to record from the capture worker,
+// the region pool and the UI thread while another thread takes snapshots.
+class CaptureTelemetry {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr Clock::duration DEFAULT_LATE_THRESHOLD = std::chrono::milliseconds(5);
+
+    explicit CaptureTelemetry(Clock::duration lateThreshold = DEFAULT_LATE_THRESHOLD);
+    CaptureTelemetry(const CaptureTelemetry&) = delete;
+    CaptureTelemetry& operator=(const CaptureTelemetry&) = delete;
+
+    void Reset();
+    void Record(CaptureStage stage, Clock::duration latency);
+    // Records a tick that was planned at scheduled, ran from started to finished, and came after skippedTicks missed ones
+    void RecordTick(Clock::time_point scheduled, Clock::time_point started, Clock::time_point finished, uint64_t skippedTicks);
+
+    TelemetrySnapshot GetSnapshot() const;
+
+private:
+    Clock::duration dLateThreshold;
+    LatencyHistogram lhStages[CAPTURE_STAGE_COUNT];
+    std::atomic<uint64_t> iTickCount;
+    std::atomic<uint64_t> iLateTicks;
+    std::atomic<uint64_t> iMissedTicks;
+};
+
+// Table of the tick counters and of the count, mean, percentiles and maximum of each stage, in milliseconds.
+// With withHistograms, the counts of every non empty bucket follow, one line per bucket and one column per stage.
+std::string formatTelemetryReport(const TelemetrySnapshot& snapshot, bool withHistograms);
+void writeTelemetryReport(std::ostream& file, const TelemetrySnapshot& snapshot, bool withHistograms);
+
+#endif
@@ -0,0 +1,66 @@
+#include "captureworker.h"
+#include <algorithm>
+#ifdef _WIN32
+#    include <windows.h>
+#    include <timeapi.h>
+#endif
+
+CaptureWorker::CaptureWorker()
+    : bStopRequested(false)
+    , iTickCount(0)
+    , iMissedTicks(0) {
+}
+
+CaptureWorker::~CaptureWorker() {
+    Stop();
+}
+
+void CaptureWorker::Start(TickHandler onTick) {
+    Stop();
+    bStopRequested = false;
+    iTickCount = 0;
+    iMissedTicks = 0;
+    tThread = std::thread(&CaptureWorker::Run, this, std::move(onTick));
+}
+
+void CaptureWorker::Stop() {
+    if (!tThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mStop);
+        bStopRequested = true;
+    }
+    cvStop.notify_all();
+    tThread.join();
+}
+
+void CaptureWorker::Run(TickHandler onTick) {
+#ifdef _WIN32
+    // Timed waits follow the system timer resolution, which defaults to 15.6 ms
+    timeBeginPeriod(1);
+#endif
+    auto nextTick = Clock::now();
+    uint64_t skippedTicks = 0;
+    std::unique_lock<std::mutex> lock(mStop);
+    while (!cvStop.wait_until(lock, nextTick, [this] { return bStopRequested; })) {
+        lock.unlock();
+        auto interval = onTick({nextTick, Clock::now(), skippedTicks});
+        iTickCount.fetch_add(1, std::memory_order_relaxed);
+        lock.lock();
+        interval = (std::max)(interval, Clock::duration(std::chrono::microseconds(100)));
+        nextTick += interval;
+        // When a tick overran, skips the deadlines already gone instead of bursting to catch up
+        const auto now = Clock::now();
+        skippedTicks = 0;
+        if (now >= nextTick) {
+            const auto late = (now - nextTick) / interval + 1;
+            skippedTicks = (uint64_t)late;
+            iMissedTicks.fetch_add(skippedTicks, std::memory_order_relaxed);
+            nextTick += late * interval;
+        }
+    }
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
@@ -0,0 +1,57 @@
+#ifndef __CAPGRAPH_CAPTUREWORKER_H__
+#define __CAPGRAPH_CAPTUREWORKER_H__
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs capture ticks on a dedicated thread, paced by the steady clock instead of window timers. Each tick returns the
+// delay until the next one. Ticks that could not start on time are skipped (and counted) rather than run back to back.
+class CaptureWorker {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct TickTiming {
+        Clock::time_point tpScheduled;
+        Clock::time_point tpStarted;
+        // Deadlines skipped right before this tick, because the previous one overran
+        uint64_t iSkippedTicks;
+    };
+    typedef std::function<Clock::duration(const TickTiming&)> TickHandler;
+
+    CaptureWorker();
+    ~CaptureWorker();
+    CaptureWorker(const CaptureWorker&) = delete;
+    CaptureWorker& operator=(const CaptureWorker&) = delete;
+
+    // Starts calling onTick on the worker thread, right away and then after each returned delay.
+    // Restarts the worker if it was running.
+    void Start(TickHandler onTick);
+    // Asks the worker to stop and waits for the current tick to finish. Must not be called from a tick.
+    void Stop();
+
+    bool IsRunning() const {
+        return tThread.joinable();
+    }
+    uint64_t GetTickCount() const {
+        return iTickCount.load(std::memory_order_relaxed);
+    }
+    uint64_t GetMissedTicks() const {
+        return iMissedTicks.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::thread tThread;
+    std::mutex mStop;
+    std::condition_variable cvStop;
+    bool bStopRequested;
+    std::atomic<uint64_t> iTickCount;
+    std::atomic<uint64_t> iMissedTicks;
+
+    void Run(TickHandler onTick);
+};
+
+#endif
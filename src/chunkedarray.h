@@ -0,0 +1,68 @@
+#ifndef __CAPGRAPH_CHUNKEDARRAY_H__
+#define __CAPGRAPH_CHUNKEDARRAY_H__
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Append-only array stored in fixed size chunks of 2^ChunkShift elements, of which the oldest can be released whole.
+// Growing only allocates a new chunk: the elements already stored are never moved nor copied, and stay at the same address.
+template <typename T, size_t ChunkShift = 12>
+class ChunkedArray {
+public:
+    static constexpr size_t CHUNK_SIZE = (size_t)1 << ChunkShift;
+    static constexpr size_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+    ChunkedArray()
+        : iSize(0) {
+    }
+    ChunkedArray(const ChunkedArray&) = delete;
+    ChunkedArray& operator=(const ChunkedArray&) = delete;
+
+    size_t size() const {
+        return iSize;
+    }
+    bool empty() const {
+        return iSize == 0;
+    }
+
+    T& operator[](size_t index) {
+        return vChunks[index >> ChunkShift][index & CHUNK_MASK];
+    }
+    const T& operator[](size_t index) const {
+        return vChunks[index >> ChunkShift][index & CHUNK_MASK];
+    }
+
+    // Elements of a chunk; they stay valid until the chunk is released, whatever is appended meanwhile
+    const T* chunk(size_t index) const {
+        return vChunks[index].get();
+    }
+
+    void push_back(const T& value) {
+        if ((iSize >> ChunkShift) == vChunks.size()) {
+            vChunks.emplace_back(new T[CHUNK_SIZE]);
+        }
+        (*this)[iSize++] = value;
+    }
+
+    // Releases the first count chunks; the elements after them move down by count * CHUNK_SIZE indices without being copied
+    void erase_front_chunks(size_t count) {
+        count = (std::min)(count, vChunks.size());
+        vChunks.erase(vChunks.begin(), vChunks.begin() + count);
+        iSize = iSize > count * CHUNK_SIZE ? iSize - count * CHUNK_SIZE : 0;
+    }
+
+    // Releases all the chunks
+    void clear() {
+        vChunks.clear();
+        vChunks.shrink_to_fit();
+        iSize = 0;
+    }
+
+private:
+    // Only the chunk pointers are moved when this vector grows
+    std::vector<std::unique_ptr<T[]>> vChunks;
+    size_t iSize;
+};
+
+#endif
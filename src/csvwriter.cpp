@@ -0,0 +1,80 @@
+#include "csvwriter.h"
+#include "captureformat.h"
+
+constexpr size_t CaptureCsvWriter::DEFAULT_BUFFER_SIZE;
+constexpr std::chrono::milliseconds CaptureCsvWriter::DEFAULT_FLUSH_INTERVAL;
+
+std::shared_ptr<CaptureCsvWriter> CaptureCsvWriter::Create(const std::string& path, const std::string& delimiter, bool append,
+                                                           Clock::duration flushInterval) {
+    // Text mode, so the lines end like the ones written by the save command
+    return Open(fopen(path.c_str(), append ? "a" : "w"), delimiter, flushInterval);
+}
+
+#ifdef _WIN32
+std::shared_ptr<CaptureCsvWriter> CaptureCsvWriter::Create(const std::wstring& path, const std::string& delimiter, bool append,
+                                                           Clock::duration flushInterval) {
+    return Open(_wfopen(path.c_str(), append ? L"a" : L"w"), delimiter, flushInterval);
+}
+#endif
+
+std::shared_ptr<CaptureCsvWriter> CaptureCsvWriter::Open(FILE* file, const std::string& delimiter, Clock::duration flushInterval) {
+    if (!file) {
+        return nullptr;
+    }
+    auto writer = std::shared_ptr<CaptureCsvWriter>(new CaptureCsvWriter(file, delimiter, flushInterval));
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) {
+        writer->sBuffer = formatCaptureHeader(delimiter);
+        writer->Flush();
+    }
+    return writer;
+}
+
+CaptureCsvWriter::CaptureCsvWriter(FILE* file, const std::string& delimiter, Clock::duration flushInterval)
+    : pFile(file)
+    , sDelimiter(delimiter)
+    , dFlushInterval(flushInterval)
+    , tpLastFlush(Clock::now())
+    , bGood(true) {
+    sBuffer.reserve(DEFAULT_BUFFER_SIZE);
+}
+
+CaptureCsvWriter::~CaptureCsvWriter() {
+    WriteBuffer();
+    fclose(pFile);
+}
+
+void CaptureCsvWriter::Append(const CaptureItem& item) {
+    // Formats straight into the buffer, which only grows past its reserved size for long delimiters
+    const size_t size = sBuffer.size();
+    sBuffer.resize(size + getCaptureLineMaxLength(sDelimiter.size()));
+    char* end = formatCaptureLine(item, sDelimiter.data(), sDelimiter.size(), &sBuffer[size]);
+    sBuffer.resize(end - sBuffer.data());
+    if (sBuffer.size() >= DEFAULT_BUFFER_SIZE) {
+        WriteBuffer();
+    }
+    FlushIfDue();
+}
+
+void CaptureCsvWriter::FlushIfDue() {
+    if (Clock::now() - tpLastFlush >= dFlushInterval) {
+        Flush();
+    }
+}
+
+void CaptureCsvWriter::Flush() {
+    WriteBuffer();
+    if (fflush(pFile) != 0) {
+        bGood = false;
+    }
+    tpLastFlush = Clock::now();
+}
+
+void CaptureCsvWriter::WriteBuffer() {
+    if (!sBuffer.empty()) {
+        if (fwrite(sBuffer.data(), 1, sBuffer.size(), pFile) != sBuffer.size()) {
+            bGood = false;
+        }
+        sBuffer.clear();
+    }
+}
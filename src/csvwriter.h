@@ -0,0 +1,56 @@
+#ifndef __CAPGRAPH_CSVWRITER_H__
+#define __CAPGRAPH_CSVWRITER_H__
+#include "captureitem.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// Writes capture items to a CSV file as they are recorded. Lines are gathered in a bounded buffer and handed to the
+// system in groups: when the buffer fills up and, at the latest, once per flush interval. A crash then loses at most
+// the last interval, and no write stalls on a per-line flush.
+class CaptureCsvWriter {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+    static constexpr std::chrono::milliseconds DEFAULT_FLUSH_INTERVAL = std::chrono::milliseconds(1000);
+
+    // Opens path, keeping its lines when append is set. The BOM and the header are only written to empty files.
+    // Returns null when the file can't be opened.
+    static std::shared_ptr<CaptureCsvWriter> Create(const std::string& path, const std::string& delimiter, bool append,
+                                                    Clock::duration flushInterval = DEFAULT_FLUSH_INTERVAL);
+#ifdef _WIN32
+    static std::shared_ptr<CaptureCsvWriter> Create(const std::wstring& path, const std::string& delimiter, bool append,
+                                                    Clock::duration flushInterval = DEFAULT_FLUSH_INTERVAL);
+#endif
+    // Flushes the buffered lines
+    ~CaptureCsvWriter();
+
+    void Append(const CaptureItem& item);
+    // Flushes when the flush interval elapsed since the last flush; meant to be called regularly
+    void FlushIfDue();
+    void Flush();
+
+    // False once a write failed
+    bool IsGood() const {
+        return bGood;
+    }
+
+private:
+    CaptureCsvWriter(FILE* file, const std::string& delimiter, Clock::duration flushInterval);
+    CaptureCsvWriter(const CaptureCsvWriter&) = delete;
+    CaptureCsvWriter& operator=(const CaptureCsvWriter&) = delete;
+
+    static std::shared_ptr<CaptureCsvWriter> Open(FILE* file, const std::string& delimiter, Clock::duration flushInterval);
+    void WriteBuffer();
+
+    FILE* pFile;
+    std::string sDelimiter;
+    std::string sBuffer;
+    Clock::duration dFlushInterval;
+    Clock::time_point tpLastFlush;
+    bool bGood;
+};
+
+#endif
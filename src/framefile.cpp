@@ -0,0 +1,472 @@
+#include "framefile.h"
+#include <algorithm>
+#include <cstring>
+
+static const char FRAME_FILE_MAGIC[4] = {'C', 'G', 'R', 'F'};
+static const char FRAME_RECORD_MAGIC[4] = {'C', 'G', 'F', 'R'};
+static const char FRAME_INDEX_MAGIC[4] = {'C', 'G', 'F', 'I'};
+constexpr uint32_t FRAME_FILE_RAW_VERSION = 1;
+constexpr uint32_t FRAME_FILE_VERSION = 2;
+// Frame files are written with the native byte order, which is little endian on every supported target
+static_assert(sizeof(FrameFileHeader) == 16, "FrameFileHeader must not be padded");
+static_assert(sizeof(FrameRecordHeader) == 24, "FrameRecordHeader must not be padded");
+static_assert(sizeof(FrameIndexEntry) == 24, "FrameIndexEntry must not be padded");
+static_assert(sizeof(FrameFileFooter) == 16, "FrameFileFooter must not be padded");
+
+// Shortest run or copy worth a code of its own instead of being part of a literal
+constexpr size_t MIN_CODE_WORDS = 3;
+// Shortest unchanged stretch that ends a changed span of a delta frame
+constexpr size_t MIN_UNCHANGED_WORDS = 16;
+// Words compared at once when looking for the end of an unchanged stretch
+constexpr size_t COMPARE_BLOCK_WORDS = 64;
+
+//--------------------------------------------------------------------------------------------
+// Codes
+//--------------------------------------------------------------------------------------------
+static void writeCode(std::vector<uint8_t>& codes, size_t count, int kind) {
+    uint64_t value = ((uint64_t)count << 2) | (uint64_t)kind;
+    while (value >= 0x80) {
+        codes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    codes.push_back((uint8_t)value);
+}
+
+static void writeLiteral(std::vector<uint8_t>& codes, const uint32_t* words, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    writeCode(codes, count, FRAME_CODE_LITERAL);
+    const size_t offset = codes.size();
+    codes.resize(offset + count * sizeof(uint32_t));
+    memcpy(&codes[offset], words, count * sizeof(uint32_t));
+}
+
+// Codes count words as literals, runs and, when above is not zero, copies of the words above positions before
+static void encodeWords(const uint32_t* words, size_t count, size_t above, std::vector<uint8_t>& codes) {
+    size_t literal = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && words[i + run] == words[i]) {
+            run++;
+        }
+        size_t copy = 0;
+        if (above && i >= above) {
+            while (i + copy < count && words[i + copy] == words[i + copy - above]) {
+                copy++;
+            }
+        }
+        if ((std::max)(run, copy) < MIN_CODE_WORDS) {
+            i++;
+            continue;
+        }
+        writeLiteral(codes, words + literal, i - literal);
+        if (run >= copy) {
+            writeCode(codes, run, FRAME_CODE_RUN);
+            const size_t offset = codes.size();
+            codes.resize(offset + sizeof(uint32_t));
+            memcpy(&codes[offset], &words[i], sizeof(uint32_t));
+            i += run;
+        } else {
+            writeCode(codes, copy, FRAME_CODE_ABOVE);
+            i += copy;
+        }
+        literal = i;
+    }
+    writeLiteral(codes, words + literal, count - literal);
+}
+
+// Number of equal words at the start of a and b
+static size_t getEqualLength(const uint32_t* a, const uint32_t* b, size_t count) {
+    size_t n = 0;
+    while (count - n >= COMPARE_BLOCK_WORDS && memcmp(a + n, b + n, COMPARE_BLOCK_WORDS * sizeof(uint32_t)) == 0) {
+        n += COMPARE_BLOCK_WORDS;
+    }
+    while (n < count && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+// Codes the XOR of pixels with previous: unchanged stretches become zero runs, and the changed spans between them are
+// coded like key frames, without copies. previous is then updated to pixels.
+static void encodeDelta(const uint32_t* pixels, uint32_t* previous, size_t count, std::vector<uint32_t>& residual,
+                        std::vector<uint8_t>& codes) {
+    size_t i = 0;
+    while (i < count) {
+        const size_t unchanged = getEqualLength(pixels + i, previous + i, count - i);
+        if (unchanged > 0) {
+            writeCode(codes, unchanged, FRAME_CODE_RUN);
+            codes.insert(codes.end(), sizeof(uint32_t), 0);
+            i += unchanged;
+        }
+        if (i == count) {
+            break;
+        }
+        // The changed span ends at the next long enough unchanged stretch
+        size_t end = i;
+        size_t equal = 0;
+        while (end < count && equal < MIN_UNCHANGED_WORDS) {
+            equal = pixels[end] == previous[end] ? equal + 1 : 0;
+            end++;
+        }
+        if (equal == MIN_UNCHANGED_WORDS) {
+            end -= equal;
+        }
+        residual.resize(end - i);
+        for (size_t k = i; k < end; k++) {
+            residual[k - i] = pixels[k] ^ previous[k];
+            previous[k] = pixels[k];
+        }
+        encodeWords(residual.data(), end - i, 0, codes);
+        i = end;
+    }
+}
+
+// Decodes the codes of a frame over words. Delta frames are XORed in place, so zero runs cost nothing.
+// Returns false when the codes don't describe exactly count words.
+static bool decodeWords(const uint8_t* codes, size_t size, uint32_t* words, size_t count, size_t above, bool delta) {
+    const uint8_t* end = codes + size;
+    size_t i = 0;
+    while (codes < end) {
+        uint64_t value = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            if (codes == end || shift > 63) {
+                return false;
+            }
+            byte = *codes++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        const int kind = (int)(value & 3);
+        const uint64_t length = value >> 2;
+        if (length > count - i) {
+            return false;
+        }
+        const size_t n = (size_t)length;
+        uint32_t* out = words + i;
+        if (kind == FRAME_CODE_LITERAL) {
+            if ((size_t)(end - codes) < n * sizeof(uint32_t)) {
+                return false;
+            }
+            if (delta) {
+                for (size_t k = 0; k < n; k++) {
+                    uint32_t word;
+                    memcpy(&word, codes + k * sizeof(uint32_t), sizeof(word));
+                    out[k] ^= word;
+                }
+            } else {
+                memcpy(out, codes, n * sizeof(uint32_t));
+            }
+            codes += n * sizeof(uint32_t);
+        } else if (kind == FRAME_CODE_RUN) {
+            uint32_t word;
+            if ((size_t)(end - codes) < sizeof(word)) {
+                return false;
+            }
+            memcpy(&word, codes, sizeof(word));
+            codes += sizeof(word);
+            if (!delta) {
+                std::fill(out, out + n, word);
+            } else if (word != 0) {
+                for (size_t k = 0; k < n; k++) {
+                    out[k] ^= word;
+                }
+            }
+        } else if (kind == FRAME_CODE_ABOVE && !delta && above && i >= above) {
+            // Overlapping copies repeat the rows above, so this can't be a memmove
+            for (size_t k = 0; k < n; k++) {
+                out[k] = out[k - above];
+            }
+        } else {
+            return false;
+        }
+        i += n;
+    }
+    return i == count;
+}
+
+//--------------------------------------------------------------------------------------------
+// FrameFileWriter implementation
+//--------------------------------------------------------------------------------------------
+std::shared_ptr<FrameFileWriter> FrameFileWriter::Create(const std::string& path, int width, int height) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return nullptr;
+    }
+    return std::shared_ptr<FrameFileWriter>(new FrameFileWriter(file, width, height));
+}
+
+#ifdef _WIN32
+std::shared_ptr<FrameFileWriter> FrameFileWriter::Create(const std::wstring& path, int width, int height) {
+    FILE* file = _wfopen(path.c_str(), L"wb");
+    if (!file) {
+        return nullptr;
+    }
+    return std::shared_ptr<FrameFileWriter>(new FrameFileWriter(file, width, height));
+}
+#endif
+
+FrameFileWriter::FrameFileWriter(FILE* file, int width, int height)
+    : pFile(file)
+    , iWidth((std::max)(width, 0))
+    , iHeight((std::max)(height, 0))
+    , iOffset(0)
+    , bGood(true)
+    , iKeyFrameBytes(0)
+    , iDeltaBytes(0)
+    , iDeltaFrames(0) {
+    FrameFileHeader header;
+    memcpy(header.aMagic, FRAME_FILE_MAGIC, sizeof(header.aMagic));
+    header.iVersion = FRAME_FILE_VERSION;
+    header.iWidth = iWidth;
+    header.iHeight = iHeight;
+    Write(&header, sizeof(header));
+}
+
+FrameFileWriter::~FrameFileWriter() {
+    Close();
+}
+
+void FrameFileWriter::Write(const void* data, size_t size) {
+    if (fwrite(data, 1, size, pFile) != size) {
+        bGood = false;
+    }
+    iOffset += size;
+}
+
+bool FrameFileWriter::WriteFrame(const uint32_t* pixels, int64_t timestamp) {
+    if (!pFile) {
+        return false;
+    }
+    const size_t pixelCount = (size_t)iWidth * iHeight;
+    const bool keyFrame = vPrevious.empty() || iDeltaBytes >= iKeyFrameBytes || iDeltaFrames >= KEY_FRAME_MAX_INTERVAL;
+    vCodes.clear();
+    if (keyFrame) {
+        encodeWords(pixels, pixelCount, (size_t)iWidth, vCodes);
+        vPrevious.assign(pixels, pixels + pixelCount);
+    } else {
+        encodeDelta(pixels, vPrevious.data(), pixelCount, vResidual, vCodes);
+    }
+
+    FrameRecordHeader header;
+    memcpy(header.aMagic, FRAME_RECORD_MAGIC, sizeof(header.aMagic));
+    header.iFlags = keyFrame ? FRAME_FLAG_KEY : 0;
+    header.iTimestamp = timestamp;
+    header.iDataSize = (uint32_t)vCodes.size();
+    header.iReserved = 0;
+    vIndex.push_back({iOffset, timestamp, header.iFlags, 0});
+    Write(&header, sizeof(header));
+    Write(vCodes.data(), vCodes.size());
+
+    const uint64_t recordBytes = sizeof(header) + vCodes.size();
+    if (keyFrame) {
+        iKeyFrameBytes = recordBytes;
+        iDeltaBytes = 0;
+        iDeltaFrames = 0;
+    } else {
+        iDeltaBytes += recordBytes;
+        iDeltaFrames++;
+    }
+    return bGood;
+}
+
+bool FrameFileWriter::Close() {
+    if (!pFile) {
+        return bGood;
+    }
+    FrameFileFooter footer;
+    footer.iIndexOffset = iOffset;
+    footer.iFrameCount = (uint32_t)vIndex.size();
+    memcpy(footer.aMagic, FRAME_INDEX_MAGIC, sizeof(footer.aMagic));
+    Write(vIndex.data(), vIndex.size() * sizeof(FrameIndexEntry));
+    Write(&footer, sizeof(footer));
+    if (fclose(pFile) != 0) {
+        bGood = false;
+    }
+    pFile = nullptr;
+    return bGood;
+}
+
+//--------------------------------------------------------------------------------------------
+// FrameFileReader implementation
+//--------------------------------------------------------------------------------------------
+std::shared_ptr<FrameFileReader> FrameFileReader::Open(const std::string& path) {
+    auto file = MappedFile::Open(path);
+    if (!file || file->GetSize() < sizeof(FrameFileHeader)) {
+        return nullptr;
+    }
+    FrameFileHeader header;
+    memcpy(&header, file->GetData(), sizeof(header));
+    if (memcmp(header.aMagic, FRAME_FILE_MAGIC, sizeof(header.aMagic)) != 0 ||
+        (header.iVersion != FRAME_FILE_RAW_VERSION && header.iVersion != FRAME_FILE_VERSION) || header.iWidth <= 0 ||
+        header.iHeight <= 0) {
+        return nullptr;
+    }
+    std::shared_ptr<FrameFileReader> reader(new FrameFileReader(std::move(file), header));
+    if (reader->iVersion == FRAME_FILE_VERSION) {
+        reader->bComplete = reader->LoadIndex();
+        if (!reader->bComplete) {
+            reader->ScanFrames();
+        }
+        for (size_t frame = 0; frame < reader->vIndex.size(); frame++) {
+            if (reader->vIndex[frame].iFlags & FRAME_FLAG_KEY) {
+                reader->vKeyFrames.push_back(frame);
+            }
+        }
+    }
+    reader->iDecodedFrame = reader->GetFrameCount();
+    return reader;
+}
+
+FrameFileReader::FrameFileReader(std::shared_ptr<MappedFile> file, const FrameFileHeader& header)
+    : pFile(std::move(file))
+    , iVersion(header.iVersion)
+    , iWidth(header.iWidth)
+    , iHeight(header.iHeight)
+    , bComplete(header.iVersion == FRAME_FILE_RAW_VERSION)
+    , iDecodedFrame(0)
+    , iNextFrame(0) {
+}
+
+bool FrameFileReader::LoadIndex() {
+    const size_t size = pFile->GetSize();
+    if (size < sizeof(FrameFileHeader) + sizeof(FrameFileFooter)) {
+        return false;
+    }
+    FrameFileFooter footer;
+    memcpy(&footer, pFile->GetData() + size - sizeof(footer), sizeof(footer));
+    const uint64_t indexSize = (uint64_t)footer.iFrameCount * sizeof(FrameIndexEntry);
+    if (memcmp(footer.aMagic, FRAME_INDEX_MAGIC, sizeof(footer.aMagic)) != 0 || footer.iIndexOffset < sizeof(FrameFileHeader) ||
+        footer.iIndexOffset + indexSize + sizeof(footer) != size) {
+        return false;
+    }
+    vIndex.resize(footer.iFrameCount);
+    memcpy(vIndex.data(), pFile->GetData() + footer.iIndexOffset, indexSize);
+    return true;
+}
+
+void FrameFileReader::ScanFrames() {
+    // Walks the frames that were completely written, stopping at the first torn one
+    const size_t size = pFile->GetSize();
+    uint64_t offset = sizeof(FrameFileHeader);
+    while (offset + sizeof(FrameRecordHeader) <= size) {
+        FrameRecordHeader header;
+        memcpy(&header, pFile->GetData() + offset, sizeof(header));
+        if (memcmp(header.aMagic, FRAME_RECORD_MAGIC, sizeof(header.aMagic)) != 0 ||
+            offset + sizeof(header) + header.iDataSize > size || (vIndex.empty() && !(header.iFlags & FRAME_FLAG_KEY))) {
+            break;
+        }
+        vIndex.push_back({offset, header.iTimestamp, header.iFlags, 0});
+        offset += sizeof(header) + header.iDataSize;
+    }
+}
+
+size_t FrameFileReader::GetFrameCount() const {
+    if (iVersion == FRAME_FILE_RAW_VERSION) {
+        return (pFile->GetSize() - sizeof(FrameFileHeader)) / (sizeof(int64_t) + GetPixelCount() * sizeof(uint32_t));
+    }
+    return vIndex.size();
+}
+
+int64_t FrameFileReader::GetTimestamp(size_t frame) const {
+    if (iVersion == FRAME_FILE_RAW_VERSION) {
+        int64_t timestamp;
+        const size_t frameBytes = sizeof(int64_t) + GetPixelCount() * sizeof(uint32_t);
+        memcpy(&timestamp, pFile->GetData() + sizeof(FrameFileHeader) + frame * frameBytes, sizeof(timestamp));
+        return timestamp;
+    }
+    return vIndex[frame].iTimestamp;
+}
+
+bool FrameFileReader::DecodeFrame(size_t frame) {
+    const FrameIndexEntry& entry = vIndex[frame];
+    const uint8_t* data = pFile->GetData() + entry.iOffset;
+    FrameRecordHeader header;
+    if (entry.iOffset + sizeof(header) > pFile->GetSize()) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.aMagic, FRAME_RECORD_MAGIC, sizeof(header.aMagic)) != 0 ||
+        entry.iOffset + sizeof(header) + header.iDataSize > pFile->GetSize()) {
+        return false;
+    }
+    const bool keyFrame = (header.iFlags & FRAME_FLAG_KEY) != 0;
+    vFrame.resize(GetPixelCount());
+    if (!decodeWords(data + sizeof(header), header.iDataSize, vFrame.data(), vFrame.size(), (size_t)iWidth, !keyFrame)) {
+        // The frame is partly decoded, so it can't be the reference of the next one
+        iDecodedFrame = GetFrameCount();
+        return false;
+    }
+    iDecodedFrame = frame;
+    return true;
+}
+
+bool FrameFileReader::DecodeTo(size_t frame) {
+    if (iDecodedFrame == frame) {
+        return true;
+    }
+    // Frames are decoded from the last key frame, unless the frame held already leads there
+    auto key = std::upper_bound(vKeyFrames.begin(), vKeyFrames.end(), frame);
+    if (key == vKeyFrames.begin()) {
+        return false;
+    }
+    size_t first = *(key - 1);
+    if (iDecodedFrame < frame && iDecodedFrame >= first) {
+        first = iDecodedFrame + 1;
+    }
+    for (size_t i = first; i <= frame; i++) {
+        if (!DecodeFrame(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FrameFileReader::ReadFrame(uint32_t* pixels, int64_t& timestamp) {
+    if (iNextFrame >= GetFrameCount()) {
+        return false;
+    }
+    const size_t pixelCount = GetPixelCount();
+    if (iVersion == FRAME_FILE_RAW_VERSION) {
+        const uint8_t* data =
+            pFile->GetData() + sizeof(FrameFileHeader) + iNextFrame * (sizeof(int64_t) + pixelCount * sizeof(uint32_t));
+        memcpy(&timestamp, data, sizeof(timestamp));
+        memcpy(pixels, data + sizeof(timestamp), pixelCount * sizeof(uint32_t));
+    } else {
+        if (!DecodeTo(iNextFrame)) {
+            return false;
+        }
+        timestamp = vIndex[iNextFrame].iTimestamp;
+        memcpy(pixels, vFrame.data(), pixelCount * sizeof(uint32_t));
+    }
+    iNextFrame++;
+    return true;
+}
+
+bool FrameFileReader::SeekFrame(size_t frame) {
+    if (frame > GetFrameCount()) {
+        return false;
+    }
+    iNextFrame = frame;
+    return true;
+}
+
+size_t FrameFileReader::FindFrame(int64_t timestamp) const {
+    // Binary search on the timestamps, read from the index or from the raw frames
+    size_t first = 0;
+    size_t count = GetFrameCount();
+    while (count > 0) {
+        const size_t half = count / 2;
+        if (GetTimestamp(first + half) <= timestamp) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first > 0 ? first - 1 : 0;
+}
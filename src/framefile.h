@@ -0,0 +1,167 @@
+#ifndef __CAPGRAPH_FRAMEFILE_H__
+#define __CAPGRAPH_FRAMEFILE_H__
+#include "mappedfile.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Frame recordings. All values are little endian.
+//
+// Version 1 (raw): FrameFileHeader, then each frame as its FILETIME timestamp followed by the BGRA32 pixels, row by row.
+//
+// Version 2 (compressed):
+//   FrameFileHeader
+//   Frames, each one made of a FrameRecordHeader and iDataSize bytes of codes
+//   Index: one FrameIndexEntry per frame
+//   FrameFileFooter
+//
+// Key frames code their pixels. The other frames code the XOR of their pixels with the previous frame's, which is zero
+// wherever the screen did not change. Codes are LEB128 values (count << 2 | kind) where kind is a FRAME_CODE_* value:
+// literals are followed by count 32-bit words, runs by the word repeated count times, and above copies count words
+// from one row up (key frames only). Files that were not closed have no index nor footer; their frames are still read
+// by walking them from the header.
+
+constexpr uint32_t FRAME_FLAG_KEY = 1;
+
+enum {
+    FRAME_CODE_LITERAL = 0,
+    FRAME_CODE_RUN = 1,
+    FRAME_CODE_ABOVE = 2,
+};
+
+// Most frames between two key frames. A key frame also comes as soon as the frames coded since the previous one take
+// more space than it, so seeking never decodes much more than twice the size of a key frame.
+constexpr uint32_t KEY_FRAME_MAX_INTERVAL = 65536;
+
+struct FrameFileHeader {
+    char aMagic[4];
+    uint32_t iVersion;
+    int32_t iWidth;
+    int32_t iHeight;
+};
+
+struct FrameRecordHeader {
+    char aMagic[4];
+    uint32_t iFlags;
+    int64_t iTimestamp;
+    uint32_t iDataSize;
+    uint32_t iReserved;
+};
+
+struct FrameIndexEntry {
+    uint64_t iOffset;
+    int64_t iTimestamp;
+    uint32_t iFlags;
+    uint32_t iReserved;
+};
+
+struct FrameFileFooter {
+    uint64_t iIndexOffset;
+    uint32_t iFrameCount;
+    char aMagic[4];
+};
+
+// Writes compressed (version 2) recordings
+class FrameFileWriter {
+public:
+    // Returns null when the file can't be created
+    static std::shared_ptr<FrameFileWriter> Create(const std::string& path, int width, int height);
+#ifdef _WIN32
+    static std::shared_ptr<FrameFileWriter> Create(const std::wstring& path, int width, int height);
+#endif
+    // Closes the recording
+    ~FrameFileWriter();
+
+    bool WriteFrame(const uint32_t* pixels, int64_t timestamp);
+    // Writes the index and the footer. Nothing can be written afterwards.
+    bool Close();
+
+    // Bytes written so far
+    uint64_t GetSize() const {
+        return iOffset;
+    }
+    // False once a write failed
+    bool IsGood() const {
+        return bGood;
+    }
+
+private:
+    FrameFileWriter(FILE* file, int width, int height);
+    FrameFileWriter(const FrameFileWriter&) = delete;
+    FrameFileWriter& operator=(const FrameFileWriter&) = delete;
+
+    void Write(const void* data, size_t size);
+
+    FILE* pFile;
+    int iWidth;
+    int iHeight;
+    uint64_t iOffset;
+    bool bGood;
+    // Size of the last key frame, and of the frames and code bytes written after it
+    uint64_t iKeyFrameBytes;
+    uint64_t iDeltaBytes;
+    uint32_t iDeltaFrames;
+    std::vector<uint32_t> vPrevious;
+    std::vector<uint32_t> vResidual;
+    std::vector<uint8_t> vCodes;
+    std::vector<FrameIndexEntry> vIndex;
+};
+
+// Reads raw and compressed recordings through a memory mapping. Frames are read in order, and SeekFrame moves to any
+// frame by decoding from the key frame before it.
+class FrameFileReader {
+public:
+    // Returns null when the file can't be mapped or is not a frame recording
+    static std::shared_ptr<FrameFileReader> Open(const std::string& path);
+
+    int GetWidth() const {
+        return iWidth;
+    }
+    int GetHeight() const {
+        return iHeight;
+    }
+    size_t GetPixelCount() const {
+        return (size_t)iWidth * iHeight;
+    }
+    size_t GetFrameCount() const;
+    int64_t GetTimestamp(size_t frame) const;
+    // True when the file is raw or has its index, i.e. it was closed properly
+    bool IsComplete() const {
+        return bComplete;
+    }
+
+    // Reads the next frame into pixels (GetPixelCount() values). Returns false at the end of the file or when the
+    // frame is damaged.
+    bool ReadFrame(uint32_t* pixels, int64_t& timestamp);
+    // Makes frame the next one read. Returns false past the end.
+    bool SeekFrame(size_t frame);
+    // Last frame taken at or before timestamp (the first one when all came later), assuming frames were recorded in order
+    size_t FindFrame(int64_t timestamp) const;
+
+private:
+    FrameFileReader(std::shared_ptr<MappedFile> file, const FrameFileHeader& header);
+    FrameFileReader(const FrameFileReader&) = delete;
+    FrameFileReader& operator=(const FrameFileReader&) = delete;
+
+    bool LoadIndex();
+    void ScanFrames();
+    // Leaves frame decoded in vFrame
+    bool DecodeTo(size_t frame);
+    bool DecodeFrame(size_t frame);
+
+    std::shared_ptr<MappedFile> pFile;
+    uint32_t iVersion;
+    int iWidth;
+    int iHeight;
+    bool bComplete;
+    std::vector<FrameIndexEntry> vIndex;
+    std::vector<size_t> vKeyFrames;
+    std::vector<uint32_t> vFrame;
+    // Frame held by vFrame (GetFrameCount() when none) and next frame read
+    size_t iDecodedFrame;
+    size_t iNextFrame;
+};
+
+#endif
@@ -0,0 +1,624 @@
+#include "framekernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#    define CAPGRAPH_X86
+#    include <immintrin.h>
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#        define CAPGRAPH_TARGET_SSE2
+#        define CAPGRAPH_TARGET_AVX2
+#    else
+#        define CAPGRAPH_TARGET_SSE2 __attribute__((target("sse2")))
+#        define CAPGRAPH_TARGET_AVX2 __attribute__((target("avx2")))
+#    endif
+#endif
+
+// Pixels handled per SIMD block before the 32-bit lane accumulators are widened to 64 bits.
+// Each lane receives at most 2 * 2 * 255^2 = 260100 per iteration, so 16384 iterations stay below 2^32.
+constexpr size_t SIMD_BLOCK_ITERATIONS = 16384;
+
+// Pixels compared between checks of the early exit threshold (64 KiB of each frame)
+constexpr size_t EARLY_EXIT_BLOCK_PIXELS = 16384;
+
+// Confidence bound of sampled averages, in standard errors (about 99.7% for a normal estimate)
+constexpr double SAMPLE_CONFIDENCE_Z = 3.0;
+// Fewest samples for which the sample variance is trusted
+constexpr size_t MIN_SAMPLE_COUNT = 64;
+
+// The histograms are gathered as a joint R/G/B table indexed by the three high nibbles, so each pixel costs a single
+// increment. It is split in two copies so runs of equal pixels don't serialize on one counter.
+constexpr int HISTOGRAM_COPIES = 2;
+constexpr int JOINT_HISTOGRAM_SIZE = FRAME_HISTOGRAM_BINS * FRAME_HISTOGRAM_BINS * FRAME_HISTOGRAM_BINS;
+typedef uint32_t HistogramSet[HISTOGRAM_COPIES][JOINT_HISTOGRAM_SIZE];
+
+// Joint index of the nibbles of the three slots (see the pixel format descriptors)
+static inline void accumulateHistogram(HistogramSet& histograms, size_t index, const uint32_t* slots) {
+    histograms[index & (HISTOGRAM_COPIES - 1)][(slots[0] >> 4) | ((slots[1] >> 4) << 4) | ((slots[2] >> 4) << 8)]++;
+}
+
+//--------------------------------------------------------------------------------------------
+// Pixel format descriptors
+//--------------------------------------------------------------------------------------------
+// Load reads the three components of a pixel in storage order, its slots, and SLOT_CHANNELS tells the channel of each
+// slot. The kernels gather slots and only map them to channels when storing the statistics, so both 32-bit formats run
+// the same SIMD code, which reads the slots straight from bytes 0 to 2 of each word (IS_WORD).
+struct WordPixels {
+    static constexpr size_t PIXEL_SIZE = 4;
+    static constexpr bool IS_WORD = true;
+    static inline void Load(const uint8_t* pixel, uint32_t* slots) {
+        uint32_t word;
+        memcpy(&word, pixel, sizeof(word));
+        slots[0] = word & 0xFF;
+        slots[1] = (word >> 8) & 0xFF;
+        slots[2] = (word >> 16) & 0xFF;
+    }
+};
+
+struct Bgra32Pixels : WordPixels {
+    static constexpr int SLOT_CHANNELS[CHANNEL_COUNT] = {CHANNEL_BLUE, CHANNEL_GREEN, CHANNEL_RED};
+};
+
+struct Rgba32Pixels : WordPixels {
+    static constexpr int SLOT_CHANNELS[CHANNEL_COUNT] = {CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE};
+};
+
+struct Rgb24Pixels {
+    static constexpr size_t PIXEL_SIZE = 3;
+    static constexpr bool IS_WORD = false;
+    static constexpr int SLOT_CHANNELS[CHANNEL_COUNT] = {CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE};
+    static inline void Load(const uint8_t* pixel, uint32_t* slots) {
+        slots[0] = pixel[0];
+        slots[1] = pixel[1];
+        slots[2] = pixel[2];
+    }
+};
+
+struct Rgb565Pixels {
+    static constexpr size_t PIXEL_SIZE = 2;
+    static constexpr bool IS_WORD = false;
+    static constexpr int SLOT_CHANNELS[CHANNEL_COUNT] = {CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE};
+    // Widened to 8 bits by repeating the top bits, so 0x1F and 0x3F read as 255
+    static inline void Load(const uint8_t* pixel, uint32_t* slots) {
+        const uint32_t word = pixel[0] | ((uint32_t)pixel[1] << 8);
+        const uint32_t r = word >> 11, g = (word >> 5) & 0x3F, b = word & 0x1F;
+        slots[0] = (r << 3) | (r >> 2);
+        slots[1] = (g << 2) | (g >> 4);
+        slots[2] = (b << 3) | (b >> 2);
+    }
+};
+
+struct Gray8Pixels {
+    static constexpr size_t PIXEL_SIZE = 1;
+    static constexpr bool IS_WORD = false;
+    static constexpr int SLOT_CHANNELS[CHANNEL_COUNT] = {CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE};
+    static inline void Load(const uint8_t* pixel, uint32_t* slots) {
+        slots[0] = slots[1] = slots[2] = pixel[0];
+    }
+};
+
+// Calls function with the descriptor of format, so each format gets its own instance of the kernels
+template <typename Function>
+static auto withPixelFormat(PixelFormat format, Function&& function) {
+    switch (format) {
+    case PixelFormat::RGBA32:
+        return function(Rgba32Pixels());
+    case PixelFormat::RGB24:
+        return function(Rgb24Pixels());
+    case PixelFormat::RGB565:
+        return function(Rgb565Pixels());
+    case PixelFormat::Gray8:
+        return function(Gray8Pixels());
+    default:
+        return function(Bgra32Pixels());
+    }
+}
+
+//--------------------------------------------------------------------------------------------
+// Scalar kernels
+//--------------------------------------------------------------------------------------------
+template <typename Pixels>
+static uint64_t sumSquaredDifferencesScalar(const uint8_t* img1, const uint8_t* img2, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t slots1[CHANNEL_COUNT], slots2[CHANNEL_COUNT];
+        Pixels::Load(img1 + i * Pixels::PIXEL_SIZE, slots1);
+        Pixels::Load(img2 + i * Pixels::PIXEL_SIZE, slots2);
+        const int d0 = (int)slots1[0] - (int)slots2[0];
+        const int d1 = (int)slots1[1] - (int)slots2[1];
+        const int d2 = (int)slots1[2] - (int)slots2[2];
+        sum += (uint32_t)(d0 * d0 + d1 * d1 + d2 * d2);
+    }
+    return sum;
+}
+
+// Sums the blocks of columns [firstBlock, lastBlock) of a band of up to BOX_FILTER_SIZE lines
+template <typename Pixels>
+static void sumBoxesScalar(const uint8_t* pixels, size_t stride, int width, int lines, int firstBlock, int lastBlock,
+                           uint32_t* sums) {
+    for (int block = firstBlock; block < lastBlock; block++) {
+        const int xEnd = (std::min)((block + 1) * BOX_FILTER_SIZE, width);
+        uint32_t slotSums[CHANNEL_COUNT] = {0, 0, 0};
+        for (int line = 0; line < lines; line++) {
+            const uint8_t* row = pixels + (size_t)line * stride * Pixels::PIXEL_SIZE;
+            for (int x = block * BOX_FILTER_SIZE; x < xEnd; x++) {
+                uint32_t slots[CHANNEL_COUNT];
+                Pixels::Load(row + (size_t)x * Pixels::PIXEL_SIZE, slots);
+                slotSums[0] += slots[0];
+                slotSums[1] += slots[1];
+                slotSums[2] += slots[2];
+            }
+        }
+        uint32_t* sum = sums + (size_t)block * CHANNEL_COUNT;
+        for (int k = 0; k < CHANNEL_COUNT; k++) {
+            sum[Pixels::SLOT_CHANNELS[k]] = slotSums[k];
+        }
+    }
+}
+
+template <typename Pixels, bool HasReference>
+static void reduceFrameScalar(const uint8_t* img, const uint8_t* reference, size_t begin, size_t end, FrameStats& stats,
+                              HistogramSet& histograms) {
+    // Accumulates per slot in locals so the compiler can keep them in registers
+    uint64_t sums[CHANNEL_COUNT] = {0, 0, 0};
+    uint64_t squares[CHANNEL_COUNT] = {0, 0, 0};
+    uint32_t minValues[CHANNEL_COUNT] = {0xFF, 0xFF, 0xFF};
+    uint32_t maxValues[CHANNEL_COUNT] = {0, 0, 0};
+    uint64_t diffSum = 0;
+    for (size_t i = begin; i < end; i++) {
+        uint32_t slots[CHANNEL_COUNT];
+        Pixels::Load(img + i * Pixels::PIXEL_SIZE, slots);
+        for (int k = 0; k < CHANNEL_COUNT; k++) {
+            sums[k] += slots[k];
+            squares[k] += slots[k] * slots[k];
+            minValues[k] = (std::min)(minValues[k], slots[k]);
+            maxValues[k] = (std::max)(maxValues[k], slots[k]);
+        }
+        accumulateHistogram(histograms, i, slots);
+        if (HasReference) {
+            uint32_t referenceSlots[CHANNEL_COUNT];
+            Pixels::Load(reference + i * Pixels::PIXEL_SIZE, referenceSlots);
+            const int d0 = (int)slots[0] - (int)referenceSlots[0];
+            const int d1 = (int)slots[1] - (int)referenceSlots[1];
+            const int d2 = (int)slots[2] - (int)referenceSlots[2];
+            diffSum += (uint32_t)(d0 * d0 + d1 * d1 + d2 * d2);
+        }
+    }
+    for (int k = 0; k < CHANNEL_COUNT; k++) {
+        auto& channel = stats.csChannels[Pixels::SLOT_CHANNELS[k]];
+        channel.iSum += sums[k];
+        channel.iSumSquares += squares[k];
+        if (end > begin) {
+            channel.iMin = (std::min)(channel.iMin, (uint8_t)minValues[k]);
+            channel.iMax = (std::max)(channel.iMax, (uint8_t)maxValues[k]);
+        }
+    }
+    stats.iSquaredDiffSum += diffSum;
+}
+
+//--------------------------------------------------------------------------------------------
+// x86 kernels
+//--------------------------------------------------------------------------------------------
+#ifdef CAPGRAPH_X86
+CAPGRAPH_TARGET_SSE2 static uint64_t sumSquaredDifferencesSSE2(const uint32_t* img1, const uint32_t* img2, size_t count) {
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    size_t i = 0;
+    while (count - i >= 4) {
+        const size_t blockEnd = i + (std::min)((count - i) & ~(size_t)3, SIMD_BLOCK_ITERATIONS * 4);
+        __m128i blockSum = zero;
+        for (; i < blockEnd; i += 4) {
+            __m128i p1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(img1 + i)), colorMask);
+            __m128i p2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(img2 + i)), colorMask);
+            __m128i diffLo = _mm_sub_epi16(_mm_unpacklo_epi8(p1, zero), _mm_unpacklo_epi8(p2, zero));
+            __m128i diffHi = _mm_sub_epi16(_mm_unpackhi_epi8(p1, zero), _mm_unpackhi_epi8(p2, zero));
+            blockSum = _mm_add_epi32(blockSum, _mm_madd_epi16(diffLo, diffLo));
+            blockSum = _mm_add_epi32(blockSum, _mm_madd_epi16(diffHi, diffHi));
+        }
+        total = _mm_add_epi64(total, _mm_unpacklo_epi32(blockSum, zero));
+        total = _mm_add_epi64(total, _mm_unpackhi_epi32(blockSum, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return lanes[0] + lanes[1] +
+           sumSquaredDifferencesScalar<Bgra32Pixels>((const uint8_t*)(img1 + i), (const uint8_t*)(img2 + i), count - i);
+}
+
+CAPGRAPH_TARGET_AVX2 static uint64_t sumSquaredDifferencesAVX2(const uint32_t* img1, const uint32_t* img2, size_t count) {
+    const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
+    while (count - i >= 8) {
+        const size_t blockEnd = i + (std::min)((count - i) & ~(size_t)7, SIMD_BLOCK_ITERATIONS * 8);
+        __m256i blockSum = zero;
+        for (; i < blockEnd; i += 8) {
+            __m256i p1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(img1 + i)), colorMask);
+            __m256i p2 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(img2 + i)), colorMask);
+            __m256i diffLo = _mm256_sub_epi16(_mm256_unpacklo_epi8(p1, zero), _mm256_unpacklo_epi8(p2, zero));
+            __m256i diffHi = _mm256_sub_epi16(_mm256_unpackhi_epi8(p1, zero), _mm256_unpackhi_epi8(p2, zero));
+            blockSum = _mm256_add_epi32(blockSum, _mm256_madd_epi16(diffLo, diffLo));
+            blockSum = _mm256_add_epi32(blockSum, _mm256_madd_epi16(diffHi, diffHi));
+        }
+        total = _mm256_add_epi64(total, _mm256_unpacklo_epi32(blockSum, zero));
+        total = _mm256_add_epi64(total, _mm256_unpackhi_epi32(blockSum, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           sumSquaredDifferencesScalar<Bgra32Pixels>((const uint8_t*)(img1 + i), (const uint8_t*)(img2 + i), count - i);
+}
+
+// Box filter over the full blocks of a band: the 4 pixels of a block line are widened to 16 bits and folded in two,
+// so after the last line the low lanes hold the slot sums (at most 16 * 255, which fits in 16 bits).
+// Returns the number of blocks processed.
+template <typename Pixels>
+CAPGRAPH_TARGET_SSE2 static int sumBoxesSSE2(const uint32_t* pixels, size_t stride, int width, int lines, uint32_t* sums) {
+    static_assert(BOX_FILTER_SIZE == 4, "one SSE2 register per block line");
+    const __m128i zero = _mm_setzero_si128();
+    const int blocks = width / BOX_FILTER_SIZE;
+    for (int block = 0; block < blocks; block++) {
+        const uint32_t* column = pixels + block * BOX_FILTER_SIZE;
+        __m128i sum = zero;
+        for (int line = 0; line < lines; line++) {
+            const __m128i p = _mm_loadu_si128((const __m128i*)(column + (size_t)line * stride));
+            sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero)));
+        }
+        sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        uint32_t* out = sums + (size_t)block * CHANNEL_COUNT;
+        out[Pixels::SLOT_CHANNELS[0]] = (uint32_t)_mm_extract_epi16(sum, 0);
+        out[Pixels::SLOT_CHANNELS[1]] = (uint32_t)_mm_extract_epi16(sum, 1);
+        out[Pixels::SLOT_CHANNELS[2]] = (uint32_t)_mm_extract_epi16(sum, 2);
+    }
+    return blocks;
+}
+
+// Gathers sums, squares, extremes and differences with SSE2; the histogram is filled from the same cache lines.
+// Returns the number of pixels processed, the remainder is left for the scalar kernel.
+template <typename Pixels, bool HasReference>
+CAPGRAPH_TARGET_SSE2 static size_t reduceFrameSSE2(const uint32_t* img, const uint32_t* reference, size_t count, FrameStats& stats,
+                                                   HistogramSet& histograms) {
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i lowWordMask = _mm_set1_epi32(0x0000FFFF);
+    const __m128i nibbleMask = _mm_set1_epi32(0x000F0F0F);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i minPixels = _mm_set1_epi8((char)0xFF);
+    __m128i maxPixels = zero;
+    // Sums are gathered per slot (byte) with SAD, which already yields 64-bit lanes
+    __m128i sum0 = zero, sum1 = zero, sum2 = zero;
+    // Squares are kept as 64-bit pairs of slots: {0, 2} and {1, alpha}
+    __m128i squaresRB = zero, squaresGA = zero;
+    __m128i diffTotal = zero;
+    alignas(16) uint32_t binIndexes[4];
+    size_t i = 0;
+    while (count - i >= 4) {
+        const size_t blockEnd = i + (std::min)((count - i) & ~(size_t)3, SIMD_BLOCK_ITERATIONS * 4);
+        __m128i blockSquaresRB = zero, blockSquaresGA = zero, blockDiff = zero;
+        for (; i < blockEnd; i += 4) {
+            const __m128i pixels = _mm_loadu_si128((const __m128i*)(img + i));
+            minPixels = _mm_min_epu8(minPixels, pixels);
+            maxPixels = _mm_max_epu8(maxPixels, pixels);
+            sum0 = _mm_add_epi64(sum0, _mm_sad_epu8(_mm_and_si128(pixels, _mm_set1_epi32(0x000000FF)), zero));
+            sum1 = _mm_add_epi64(sum1, _mm_sad_epu8(_mm_and_si128(pixels, _mm_set1_epi32(0x0000FF00)), zero));
+            sum2 = _mm_add_epi64(sum2, _mm_sad_epu8(_mm_and_si128(pixels, _mm_set1_epi32(0x00FF0000)), zero));
+            // With the odd 16-bit words cleared, madd squares a single slot per 32-bit lane
+            const __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+            const __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+            const __m128i loRB = _mm_and_si128(lo, lowWordMask), hiRB = _mm_and_si128(hi, lowWordMask);
+            const __m128i loGA = _mm_srli_epi32(lo, 16), hiGA = _mm_srli_epi32(hi, 16);
+            blockSquaresRB = _mm_add_epi32(blockSquaresRB, _mm_add_epi32(_mm_madd_epi16(loRB, loRB), _mm_madd_epi16(hiRB, hiRB)));
+            blockSquaresGA = _mm_add_epi32(blockSquaresGA, _mm_add_epi32(_mm_madd_epi16(loGA, loGA), _mm_madd_epi16(hiGA, hiGA)));
+            if (HasReference) {
+                const __m128i refPixels = _mm_and_si128(_mm_loadu_si128((const __m128i*)(reference + i)), colorMask);
+                const __m128i masked = _mm_and_si128(pixels, colorMask);
+                const __m128i diffLo = _mm_sub_epi16(_mm_unpacklo_epi8(masked, zero), _mm_unpacklo_epi8(refPixels, zero));
+                const __m128i diffHi = _mm_sub_epi16(_mm_unpackhi_epi8(masked, zero), _mm_unpackhi_epi8(refPixels, zero));
+                blockDiff = _mm_add_epi32(blockDiff, _mm_madd_epi16(diffLo, diffLo));
+                blockDiff = _mm_add_epi32(blockDiff, _mm_madd_epi16(diffHi, diffHi));
+            }
+            // Joint histogram indexes, same layout as accumulateHistogram
+            const __m128i nibbles = _mm_and_si128(_mm_srli_epi32(pixels, 4), nibbleMask);
+            const __m128i binIndex =
+                _mm_or_si128(_mm_and_si128(nibbles, _mm_set1_epi32(0x00F)),
+                             _mm_or_si128(_mm_and_si128(_mm_srli_epi32(nibbles, 4), _mm_set1_epi32(0x0F0)),
+                                          _mm_and_si128(_mm_srli_epi32(nibbles, 8), _mm_set1_epi32(0xF00))));
+            _mm_store_si128((__m128i*)binIndexes, binIndex);
+            histograms[0][binIndexes[0]]++;
+            histograms[1][binIndexes[1]]++;
+            histograms[0][binIndexes[2]]++;
+            histograms[1][binIndexes[3]]++;
+        }
+        squaresRB = _mm_add_epi64(squaresRB, _mm_add_epi64(_mm_unpacklo_epi32(blockSquaresRB, zero), _mm_unpackhi_epi32(blockSquaresRB, zero)));
+        squaresGA = _mm_add_epi64(squaresGA, _mm_add_epi64(_mm_unpacklo_epi32(blockSquaresGA, zero), _mm_unpackhi_epi32(blockSquaresGA, zero)));
+        diffTotal = _mm_add_epi64(diffTotal, _mm_unpacklo_epi32(blockDiff, zero));
+        diffTotal = _mm_add_epi64(diffTotal, _mm_unpackhi_epi32(blockDiff, zero));
+    }
+    uint64_t sums[3][2], squaresRBLanes[2], squaresGALanes[2], diff[2];
+    uint8_t minBytes[16], maxBytes[16];
+    _mm_storeu_si128((__m128i*)sums[0], sum0);
+    _mm_storeu_si128((__m128i*)sums[1], sum1);
+    _mm_storeu_si128((__m128i*)sums[2], sum2);
+    _mm_storeu_si128((__m128i*)squaresRBLanes, squaresRB);
+    _mm_storeu_si128((__m128i*)squaresGALanes, squaresGA);
+    _mm_storeu_si128((__m128i*)diff, diffTotal);
+    _mm_storeu_si128((__m128i*)minBytes, minPixels);
+    _mm_storeu_si128((__m128i*)maxBytes, maxPixels);
+    stats.csChannels[Pixels::SLOT_CHANNELS[0]].iSumSquares += squaresRBLanes[0];
+    stats.csChannels[Pixels::SLOT_CHANNELS[1]].iSumSquares += squaresGALanes[0];
+    stats.csChannels[Pixels::SLOT_CHANNELS[2]].iSumSquares += squaresRBLanes[1];
+    for (int k = 0; k < CHANNEL_COUNT; k++) {
+        auto& channel = stats.csChannels[Pixels::SLOT_CHANNELS[k]];
+        channel.iSum += sums[k][0] + sums[k][1];
+        if (i > 0) {
+            for (int p = 0; p < 4; p++) {
+                channel.iMin = (std::min)(channel.iMin, minBytes[4 * p + k]);
+                channel.iMax = (std::max)(channel.iMax, maxBytes[4 * p + k]);
+            }
+        }
+    }
+    stats.iSquaredDiffSum += diff[0] + diff[1];
+    return i;
+}
+
+static KernelIsa detectKernelIsa() {
+#    if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool hasSse2 = (info[3] & (1 << 26)) != 0;
+    const bool hasOsXsave = (info[2] & (1 << 27)) != 0;
+    const bool hasAvx = (info[2] & (1 << 28)) != 0;
+    bool hasAvx2 = false;
+    if (maxLeaf >= 7 && hasOsXsave && hasAvx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        hasAvx2 = (info[1] & (1 << 5)) != 0;
+    }
+#    else
+    __builtin_cpu_init();
+    const bool hasSse2 = __builtin_cpu_supports("sse2");
+    const bool hasAvx2 = __builtin_cpu_supports("avx2");
+#    endif
+    if (hasAvx2) {
+        return KernelIsa::AVX2;
+    }
+    return hasSse2 ? KernelIsa::SSE2 : KernelIsa::Scalar;
+}
+#else
+static KernelIsa detectKernelIsa() {
+    return KernelIsa::Scalar;
+}
+#endif
+
+//--------------------------------------------------------------------------------------------
+// Dispatch
+//--------------------------------------------------------------------------------------------
+KernelIsa getKernelIsa() {
+    static const KernelIsa isa = detectKernelIsa();
+    return isa;
+}
+
+uint64_t sumSquaredDifferences(const void* img1, const void* img2, size_t count, PixelFormat format, KernelIsa isa) {
+    return withPixelFormat(format, [&](auto pixels) -> uint64_t {
+        typedef decltype(pixels) Pixels;
+#ifdef CAPGRAPH_X86
+        if constexpr (Pixels::IS_WORD) {
+            if (isa == KernelIsa::AVX2) {
+                return sumSquaredDifferencesAVX2((const uint32_t*)img1, (const uint32_t*)img2, count);
+            }
+            if (isa == KernelIsa::SSE2) {
+                return sumSquaredDifferencesSSE2((const uint32_t*)img1, (const uint32_t*)img2, count);
+            }
+        }
+#endif
+        (void)isa;
+        return sumSquaredDifferencesScalar<Pixels>((const uint8_t*)img1, (const uint8_t*)img2, count);
+    });
+}
+
+uint64_t sumSquaredDifferences(const void* img1, const void* img2, size_t count, PixelFormat format) {
+    return sumSquaredDifferences(img1, img2, count, format, getKernelIsa());
+}
+
+void boxFilter(const void* pixels, size_t stride, int width, int height, uint32_t* sums, PixelFormat format, KernelIsa isa) {
+    withPixelFormat(format, [&](auto descriptor) {
+        typedef decltype(descriptor) Pixels;
+        const int blocksPerRow = (width + BOX_FILTER_SIZE - 1) / BOX_FILTER_SIZE;
+        for (int y = 0; y < height; y += BOX_FILTER_SIZE) {
+            const uint8_t* band = (const uint8_t*)pixels + (size_t)y * stride * Pixels::PIXEL_SIZE;
+            const int lines = (std::min)(BOX_FILTER_SIZE, height - y);
+            uint32_t* bandSums = sums + (size_t)(y / BOX_FILTER_SIZE) * blocksPerRow * CHANNEL_COUNT;
+            int done = 0;
+#ifdef CAPGRAPH_X86
+            if constexpr (Pixels::IS_WORD) {
+                if (isa != KernelIsa::Scalar) {
+                    done = sumBoxesSSE2<Pixels>((const uint32_t*)band, stride, width, lines, bandSums);
+                }
+            }
+#endif
+            (void)isa;
+            sumBoxesScalar<Pixels>(band, stride, width, lines, done, blocksPerRow, bandSums);
+        }
+    });
+}
+
+void boxFilter(const void* pixels, size_t stride, int width, int height, uint32_t* sums, PixelFormat format) {
+    boxFilter(pixels, stride, width, height, sums, format, getKernelIsa());
+}
+
+bool imagesDiffer(const void* img1, const void* img2, size_t count, double threshold, PixelFormat format) {
+    if (count == 0) {
+        return false;
+    }
+    // The partial sum only grows and the division is monotonic, so once it passes the threshold the full MSE does too
+    const double divisor = (double)(3 * count);
+    const size_t pixelSize = getPixelSize(format);
+    const KernelIsa isa = getKernelIsa();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i += EARLY_EXIT_BLOCK_PIXELS) {
+        sum += sumSquaredDifferences((const uint8_t*)img1 + i * pixelSize, (const uint8_t*)img2 + i * pixelSize,
+                                     (std::min)(EARLY_EXIT_BLOCK_PIXELS, count - i), format, isa);
+        if ((double)sum / divisor > threshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+FrameStats reduceFrame(const void* img, const void* reference, size_t count, PixelFormat format, KernelIsa isa) {
+    FrameStats stats = {};
+    stats.iPixelCount = count;
+    for (auto& channel : stats.csChannels) {
+        channel.iMin = 0xFF;
+    }
+    static thread_local HistogramSet histograms;
+    memset(histograms, 0, sizeof(histograms));
+    withPixelFormat(format, [&](auto descriptor) {
+        typedef decltype(descriptor) Pixels;
+        const uint8_t* bytes = (const uint8_t*)img;
+        const uint8_t* referenceBytes = (const uint8_t*)reference;
+        size_t processed = 0;
+#ifdef CAPGRAPH_X86
+        // The histogram bounds the loop well before AVX2 would help, so both SIMD levels share the SSE2 kernel
+        if constexpr (Pixels::IS_WORD) {
+            if (isa != KernelIsa::Scalar) {
+                processed = reference ? reduceFrameSSE2<Pixels, true>((const uint32_t*)img, (const uint32_t*)reference, count,
+                                                                      stats, histograms)
+                                      : reduceFrameSSE2<Pixels, false>((const uint32_t*)img, nullptr, count, stats, histograms);
+            }
+        }
+#endif
+        (void)isa;
+        if (reference) {
+            reduceFrameScalar<Pixels, true>(bytes, referenceBytes, processed, count, stats, histograms);
+        } else {
+            reduceFrameScalar<Pixels, false>(bytes, referenceBytes, processed, count, stats, histograms);
+        }
+        for (int bin = 0; bin < JOINT_HISTOGRAM_SIZE; bin++) {
+            const uint32_t binCount = histograms[0][bin] + histograms[1][bin];
+            stats.csChannels[Pixels::SLOT_CHANNELS[0]].aHistogram[bin & 0xF] += binCount;
+            stats.csChannels[Pixels::SLOT_CHANNELS[1]].aHistogram[(bin >> 4) & 0xF] += binCount;
+            stats.csChannels[Pixels::SLOT_CHANNELS[2]].aHistogram[bin >> 8] += binCount;
+        }
+    });
+    if (count == 0) {
+        for (auto& channel : stats.csChannels) {
+            channel.iMin = 0;
+        }
+    }
+    return stats;
+}
+
+FrameStats reduceFrame(const void* img, const void* reference, size_t count, PixelFormat format) {
+    return reduceFrame(img, reference, count, format, getKernelIsa());
+}
+
+FrameStats sampleFrame(const void* img, const void* reference, size_t count, size_t sampleCount, uint64_t seed,
+                       PixelFormat format) {
+    if (sampleCount >= count) {
+        return reduceFrame(img, reference, count, format);
+    }
+    FrameStats stats = {};
+    stats.iPixelCount = sampleCount;
+    for (auto& channel : stats.csChannels) {
+        channel.iMin = sampleCount ? 0xFF : 0;
+    }
+    withPixelFormat(format, [&](auto descriptor) {
+        typedef decltype(descriptor) Pixels;
+        const uint8_t* bytes = (const uint8_t*)img;
+        const uint8_t* referenceBytes = (const uint8_t*)reference;
+        // Stratified sampling: its variance never exceeds the one of plain random sampling, which MeanBound assumes
+        uint64_t state = seed;
+        for (size_t k = 0; k < sampleCount; k++) {
+            const size_t begin = (size_t)((uint64_t)k * count / sampleCount);
+            const size_t end = (size_t)((uint64_t)(k + 1) * count / sampleCount);
+            // splitmix64 step
+            uint64_t random = (state += 0x9E3779B97F4A7C15ull);
+            random = (random ^ (random >> 30)) * 0xBF58476D1CE4E5B9ull;
+            random = (random ^ (random >> 27)) * 0x94D049BB133111EBull;
+            random ^= random >> 31;
+            const size_t index = begin + (size_t)(random % (end - begin));
+            uint32_t slots[CHANNEL_COUNT];
+            Pixels::Load(bytes + index * Pixels::PIXEL_SIZE, slots);
+            for (int slot = 0; slot < CHANNEL_COUNT; slot++) {
+                const uint32_t value = slots[slot];
+                auto& channel = stats.csChannels[Pixels::SLOT_CHANNELS[slot]];
+                channel.iSum += value;
+                channel.iSumSquares += value * value;
+                channel.iMin = (std::min)(channel.iMin, (uint8_t)value);
+                channel.iMax = (std::max)(channel.iMax, (uint8_t)value);
+                channel.aHistogram[value >> 4]++;
+            }
+            if (reference) {
+                stats.iSquaredDiffSum += sumSquaredDifferencesScalar<Pixels>(bytes + index * Pixels::PIXEL_SIZE,
+                                                                             referenceBytes + index * Pixels::PIXEL_SIZE, 1);
+            }
+        }
+    });
+    return stats;
+}
+
+FrameStats reduceFrameSampled(const void* img, const void* reference, size_t count, size_t sampleBudget, uint64_t seed,
+                              PixelFormat format, double maxBound) {
+    if (sampleBudget == 0 || sampleBudget >= count) {
+        return reduceFrame(img, reference, count, format);
+    }
+    const FrameStats sampled = sampleFrame(img, reference, count, (std::max)(sampleBudget, MIN_SAMPLE_COUNT), seed, format);
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+        if (sampled.MeanBound(c, count) > maxBound) {
+            return reduceFrame(img, reference, count, format);
+        }
+    }
+    return sampled;
+}
+
+double compareImages(const std::vector<uint32_t>& img1, const std::vector<uint32_t>& img2) {
+    if (img1.size() != img2.size()) {
+        return 0.0;
+    }
+    // The integer sum is exact and far below 2^53, so this matches the per-pixel double accumulation bit for bit
+    return (double)sumSquaredDifferences(img1.data(), img2.data(), img1.size()) / (3 * img1.size());
+}
+
+//--------------------------------------------------------------------------------------------
+// FrameStats implementation
+//--------------------------------------------------------------------------------------------
+double FrameStats::MeanSquareError() const {
+    return iPixelCount ? (double)iSquaredDiffSum / (3 * iPixelCount) : 0.0;
+}
+
+double FrameStats::Mean(int channel) const {
+    return iPixelCount ? (double)csChannels[channel].iSum / iPixelCount : 0.0;
+}
+
+double FrameStats::Variance(int channel) const {
+    if (!iPixelCount) {
+        return 0.0;
+    }
+    const double mean = Mean(channel);
+    return (std::max)(0.0, (double)csChannels[channel].iSumSquares / iPixelCount - mean * mean);
+}
+
+double FrameStats::MeanBound(int channel, size_t frameCount) const {
+    if (iPixelCount < 2 || iPixelCount >= frameCount) {
+        return 0.0;
+    }
+    // Unbiased sample variance, with the finite population correction
+    const double n = (double)iPixelCount;
+    const double sampleVariance = Variance(channel) * n / (n - 1);
+    const double correction = 1.0 - n / frameCount;
+    return SAMPLE_CONFIDENCE_Z * std::sqrt(sampleVariance / n * correction);
+}
+
+uint32_t FrameStats::AverageColor() const {
+    if (!iPixelCount) {
+        return 0;
+    }
+    const uint32_t r = (uint32_t)(csChannels[CHANNEL_RED].iSum / iPixelCount);
+    const uint32_t g = (uint32_t)(csChannels[CHANNEL_GREEN].iSum / iPixelCount);
+    const uint32_t b = (uint32_t)(csChannels[CHANNEL_BLUE].iSum / iPixelCount);
+    return r | (g << 8) | (b << 16);
+}
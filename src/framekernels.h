@@ -0,0 +1,96 @@
+#ifndef __CAPGRAPH_FRAMEKERNELS_H__
+#define __CAPGRAPH_FRAMEKERNELS_H__
+#include "pixelformat.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Instruction sets the frame kernels can be dispatched to
+enum class KernelIsa {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Channel indexes used by the frame statistics
+enum {
+    CHANNEL_RED = 0,
+    CHANNEL_GREEN = 1,
+    CHANNEL_BLUE = 2,
+    CHANNEL_COUNT = 3,
+};
+
+// Number of bins of the coarse per channel histogram (each bin covers 16 intensity levels)
+constexpr int FRAME_HISTOGRAM_BINS = 16;
+
+// Widest confidence bound, in intensity levels, for which a sampled average is trusted over a full pass
+constexpr double SAMPLED_MEAN_MAX_BOUND = 0.5;
+
+struct ChannelStats {
+    uint64_t iSum;
+    uint64_t iSumSquares;
+    uint8_t iMin;
+    uint8_t iMax;
+    uint32_t aHistogram[FRAME_HISTOGRAM_BINS];
+};
+
+// Statistics of a frame gathered in a single pass over its pixels
+struct FrameStats {
+    size_t iPixelCount;
+    uint64_t iSquaredDiffSum;
+    ChannelStats csChannels[CHANNEL_COUNT];
+
+    // Mean square error against the reference frame (0 when there was no reference)
+    double MeanSquareError() const;
+    double Mean(int channel) const;
+    double Variance(int channel) const;
+    // Half width of the confidence interval of Mean(channel), when these statistics were sampled from a frame of
+    // frameCount pixels (zero when the whole frame was read)
+    double MeanBound(int channel, size_t frameCount) const;
+    // Average color in COLORREF layout (0x00BBGGRR), truncated like the RGB macro does
+    uint32_t AverageColor() const;
+};
+
+// Returns the best instruction set supported by the running CPU (detected once)
+KernelIsa getKernelIsa();
+
+// The kernels below read count pixels of a given format, BGRA32 unless told otherwise. Each format gets its own loops,
+// specialized at compile time, so frames are analyzed in their native format without a conversion pass. Components are
+// widened to 8 bits (RGB565) or replicated (Gray8), and the statistics always come out in R, G, B order.
+
+// Sum of the squared differences of the R, G and B components of two frames. The alpha byte is ignored.
+uint64_t sumSquaredDifferences(const void* img1, const void* img2, size_t count, PixelFormat format = PixelFormat::BGRA32);
+// Same as above, forcing a given instruction set (must be supported by the CPU)
+uint64_t sumSquaredDifferences(const void* img1, const void* img2, size_t count, PixelFormat format, KernelIsa isa);
+
+// Tells whether the mean square error between two frames is above threshold. The frames are compared in blocks and the
+// scan stops as soon as the running sum proves the threshold was passed; the answer always matches compareImages.
+bool imagesDiffer(const void* img1, const void* img2, size_t count, double threshold, PixelFormat format = PixelFormat::BGRA32);
+
+// Side of the blocks averaged by the box filter
+constexpr int BOX_FILTER_SIZE = 4;
+
+// Downscales an area of width x height pixels, whose rows are stride pixels apart, by BOX_FILTER_SIZE in both directions.
+// Stores the exact sums of the R, G and B components of each block (partial at the right and bottom edges), row by row,
+// with ceil(width / BOX_FILTER_SIZE) blocks per row and CHANNEL_COUNT values per block.
+void boxFilter(const void* pixels, size_t stride, int width, int height, uint32_t* sums, PixelFormat format = PixelFormat::BGRA32);
+void boxFilter(const void* pixels, size_t stride, int width, int height, uint32_t* sums, PixelFormat format, KernelIsa isa);
+
+// Walks a frame once, gathering its statistics and the squared differences against reference (which may be null)
+FrameStats reduceFrame(const void* img, const void* reference, size_t count, PixelFormat format = PixelFormat::BGRA32);
+FrameStats reduceFrame(const void* img, const void* reference, size_t count, PixelFormat format, KernelIsa isa);
+
+// Gathers the statistics of sampleCount pixels, one picked at random in each of sampleCount equal slices of the frame.
+// The squared differences are also sampled, so MeanSquareError stays an estimate of the whole frame's.
+FrameStats sampleFrame(const void* img, const void* reference, size_t count, size_t sampleCount, uint64_t seed,
+                       PixelFormat format = PixelFormat::BGRA32);
+
+// Samples the frame when sampleBudget is not zero and smaller than the frame, falling back to reduceFrame when the
+// average of any channel is not known within maxBound levels. Flat frames then cost about the same at any size.
+FrameStats reduceFrameSampled(const void* img, const void* reference, size_t count, size_t sampleBudget, uint64_t seed,
+                              PixelFormat format = PixelFormat::BGRA32, double maxBound = SAMPLED_MEAN_MAX_BOUND);
+
+// Mean square error between two BGRA32 frames, per channel. Frames of different sizes compare as equal.
+double compareImages(const std::vector<uint32_t>& img1, const std::vector<uint32_t>& img2);
+
+#endif
@@ -0,0 +1,138 @@
+#include "framestream.h"
+#include "captureformat.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Events taken from epoll per wait; more ready streams are reported by the next wait
+constexpr int MAX_POLL_EVENTS = 64;
+
+//--------------------------------------------------------------------------------------------
+// FrameStream implementation
+//--------------------------------------------------------------------------------------------
+std::shared_ptr<FrameStream> FrameStream::Open(const std::string& path, int width, int height, PixelFormat format,
+                                               int bufferCount) {
+    if (width <= 0 || height <= 0 || bufferCount < 1 || bufferCount > 2) {
+        return nullptr;
+    }
+    const bool useStdin = path == "-";
+    // Opened blocking, since a FIFO opened without a writer would read as ended right away
+    const int descriptor = useStdin ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    const int flags = fcntl(descriptor, F_GETFL);
+    if (flags < 0 || fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) != 0) {
+        if (!useStdin) {
+            close(descriptor);
+        }
+        return nullptr;
+    }
+    return std::shared_ptr<FrameStream>(new FrameStream(path, descriptor, !useStdin, width, height, format, bufferCount));
+}
+
+FrameStream::FrameStream(const std::string& path, int descriptor, bool ownsDescriptor, int width, int height, PixelFormat format,
+                         int bufferCount)
+    : sPath(path)
+    , iDescriptor(descriptor)
+    , bOwnsDescriptor(ownsDescriptor)
+    , iWidth(width)
+    , iHeight(height)
+    , pfFormat(format)
+    , iBufferCount(bufferCount)
+    , iFillingBuffer(0)
+    , iFilledBytes(0)
+    , iReadyBuffer(0)
+    , iFrameCount(0)
+    , iTimestamp(0) {
+    for (int i = 0; i < iBufferCount; i++) {
+        aBuffers[i].reset((uint8_t*)::operator new[](GetFrameSize(), std::align_val_t(FRAME_BUFFER_ALIGNMENT)));
+    }
+}
+
+FrameStream::~FrameStream() {
+    if (bOwnsDescriptor) {
+        close(iDescriptor);
+    }
+}
+
+StreamStatus FrameStream::Read() {
+    const size_t frameBytes = GetFrameSize();
+    uint8_t* buffer = aBuffers[iFillingBuffer].get();
+    while (iFilledBytes < frameBytes) {
+        const ssize_t count = read(iDescriptor, buffer + iFilledBytes, frameBytes - iFilledBytes);
+        if (count > 0) {
+            iFilledBytes += (size_t)count;
+        } else if (count == 0) {
+            return StreamStatus::Ended;
+        } else if (errno != EINTR) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? StreamStatus::Waiting : StreamStatus::Failed;
+        }
+    }
+    iFilledBytes = 0;
+    iFrameCount++;
+    iTimestamp = getCurrentFileTime();
+    iReadyBuffer = iFillingBuffer;
+    iFillingBuffer = (iFillingBuffer + 1) % iBufferCount;
+    return StreamStatus::FrameReady;
+}
+
+//--------------------------------------------------------------------------------------------
+// StreamPoller implementation
+//--------------------------------------------------------------------------------------------
+std::shared_ptr<StreamPoller> StreamPoller::Create() {
+    const int descriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    return std::shared_ptr<StreamPoller>(new StreamPoller(descriptor));
+}
+
+StreamPoller::StreamPoller(int descriptor)
+    : iDescriptor(descriptor)
+    , iWatchCount(0) {
+}
+
+StreamPoller::~StreamPoller() {
+    close(iDescriptor);
+}
+
+bool StreamPoller::Add(int descriptor, size_t id) {
+    // Level triggered, so a stream left with data after a frame is reported again
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    if (epoll_ctl(iDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+        return false;
+    }
+    iWatchCount++;
+    return true;
+}
+
+void StreamPoller::Remove(int descriptor) {
+    if (epoll_ctl(iDescriptor, EPOLL_CTL_DEL, descriptor, nullptr) == 0) {
+        iWatchCount--;
+    }
+}
+
+bool StreamPoller::Wait(int timeoutMs, std::vector<size_t>& ready) {
+    ready.clear();
+    epoll_event events[MAX_POLL_EVENTS];
+    const int maxEvents = (int)(std::min)(iWatchCount, (size_t)MAX_POLL_EVENTS);
+    if (maxEvents == 0) {
+        return false;
+    }
+    int count;
+    do {
+        count = epoll_wait(iDescriptor, events, maxEvents, timeoutMs);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        ready.push_back((size_t)events[i].data.u64);
+    }
+    return true;
+}
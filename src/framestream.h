@@ -0,0 +1,126 @@
+#ifndef __CAPGRAPH_FRAMESTREAM_H__
+#define __CAPGRAPH_FRAMESTREAM_H__
+#include "pixelformat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Alignment of the stream frame buffers, so the frame kernels start on a cache line
+constexpr size_t FRAME_BUFFER_ALIGNMENT = 64;
+
+struct AlignedFrameDeleter {
+    void operator()(uint8_t* buffer) const {
+        ::operator delete[](buffer, std::align_val_t(FRAME_BUFFER_ALIGNMENT));
+    }
+};
+
+typedef std::unique_ptr<uint8_t[], AlignedFrameDeleter> AlignedFrameBuffer;
+
+enum class StreamStatus {
+    // The stream holds no more data for now
+    Waiting,
+    // A frame was completed and is available from GetFrame
+    FrameReady,
+    // The writer closed the stream; a partial last frame is dropped
+    Ended,
+    Failed,
+};
+
+// Source of fixed size frames of a given pixel format (see PixelFormat) written to a pipe, a FIFO or stdin.
+// Frames are read without blocking straight into reusable aligned buffers, used alternately so the previous frame stays
+// available as reference without being copied.
+class FrameStream {
+public:
+    // path "-" reads stdin. Opening a FIFO waits for its writer. Returns null when the stream can't be opened.
+    static std::shared_ptr<FrameStream> Open(const std::string& path, int width, int height,
+                                             PixelFormat format = PixelFormat::BGRA32, int bufferCount = 2);
+    ~FrameStream();
+
+    const std::string& GetPath() const {
+        return sPath;
+    }
+    int GetDescriptor() const {
+        return iDescriptor;
+    }
+    int GetWidth() const {
+        return iWidth;
+    }
+    int GetHeight() const {
+        return iHeight;
+    }
+    PixelFormat GetFormat() const {
+        return pfFormat;
+    }
+    size_t GetPixelCount() const {
+        return (size_t)iWidth * iHeight;
+    }
+    size_t GetFrameSize() const {
+        return GetPixelCount() * getPixelSize(pfFormat);
+    }
+    uint64_t GetFrameCount() const {
+        return iFrameCount;
+    }
+
+    // Reads what the stream holds, stopping at the end of a frame so streams sharing a thread take turns
+    StreamStatus Read();
+    // Frame completed by the last Read, valid until the Read after the next one (or the next one with a single buffer)
+    const uint8_t* GetFrame() const {
+        return aBuffers[iReadyBuffer].get();
+    }
+    // Frame completed before it, or null for the first one and with a single buffer
+    const uint8_t* GetPreviousFrame() const {
+        return iBufferCount > 1 && iFrameCount > 1 ? aBuffers[1 - iReadyBuffer].get() : nullptr;
+    }
+    // FILETIME at which the last frame was completed
+    int64_t GetTimestamp() const {
+        return iTimestamp;
+    }
+
+private:
+    FrameStream(const std::string& path, int descriptor, bool ownsDescriptor, int width, int height, PixelFormat format,
+                int bufferCount);
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    std::string sPath;
+    int iDescriptor;
+    bool bOwnsDescriptor;
+    int iWidth;
+    int iHeight;
+    PixelFormat pfFormat;
+    int iBufferCount;
+    AlignedFrameBuffer aBuffers[2];
+    // Buffer being filled, bytes already in it, and buffer of the last complete frame
+    int iFillingBuffer;
+    size_t iFilledBytes;
+    int iReadyBuffer;
+    uint64_t iFrameCount;
+    int64_t iTimestamp;
+};
+
+// Waits on many streams at once with epoll, so a single thread serves them all
+class StreamPoller {
+public:
+    // Returns null when epoll is not available
+    static std::shared_ptr<StreamPoller> Create();
+    ~StreamPoller();
+
+    // Watches a descriptor, reported as id when it has data or was closed. Fails for regular files.
+    bool Add(int descriptor, size_t id);
+    void Remove(int descriptor);
+    // Waits up to timeoutMs (-1 for ever) for watched descriptors to become readable. Returns false on errors.
+    bool Wait(int timeoutMs, std::vector<size_t>& ready);
+
+private:
+    explicit StreamPoller(int descriptor);
+    StreamPoller(const StreamPoller&) = delete;
+    StreamPoller& operator=(const StreamPoller&) = delete;
+
+    int iDescriptor;
+    size_t iWatchCount;
+};
+
+#endif
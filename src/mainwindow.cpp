@@ -1,7 +1,12 @@
 #include "mainwindow.h"
+#include "binarylog.h"
+#include "captureformat.h"
+#include "csvwriter.h"
+#include "framekernels.h"
 #include "resources.h"
+#include "sharedring.h"
 #include <CommCtrl.h>
-#include <cmath>
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <sstream>
@@ -11,14 +16,22 @@
 HINSTANCE MainWindow::hInstance = NULL;
 const WCHAR MainWindow::szClassName[] = L"CapGraphMain";
 
-const uint8_t utf8BOM[] = {0xEF, 0xBB, 0xBF};
-
-constexpr int64_t FILE_TIME_TO_MILLISECONDS = 10000ll;
+// Pixels sampled per still image when the sampled average is enabled
+constexpr size_t DEFAULT_SAMPLE_BUDGET = 4096;
+// Width of the data list; the capture previews are drawn to its right
+constexpr int DATA_LIST_WIDTH = 350;
+// Interval between refreshes of the capture rate shown in the status bar
+constexpr UINT STATUS_UPDATE_INTERVAL = 1000;
+// Capture events handled per WM_CAPTURE_EVENTS message, so a long backlog doesn't freeze the window
+constexpr size_t CAPTURE_EVENTS_BATCH = 256;
+// Items kept in memory, the most recent ones within the last hours; older ones are spilled to temporary segment files
+constexpr size_t RETAINED_ITEMS = 100000;
+constexpr int64_t RETAINED_HOURS = 24;
 
 enum {
     BID_SETAREA = 100,
     BID_STARTREC = 101,
-    TID_CAPTURE = 103,
+    TID_STATUSUPDATE = 103,
     SID_STATUSBAR = 104,
     LID_DATALIST = 105,
     BID_SAVEDATA = 106,
@@ -27,69 +40,19 @@ enum {
     TID_MAINTOOLBAR = 109,
 };
 
+enum {
+    WM_CAPTURE_EVENTS = WM_APP + 1,
+};
+
 //--------------------------------------------------------------------------------------------
 // Utility functions
 //--------------------------------------------------------------------------------------------
-static double compareImages(std::vector<uint32_t>& img1, std::vector<uint32_t>& img2) {
-    if (img1.size() != img2.size()) {
-        return 0.0;
-    }
-    double meanSquareError = 0;
-    for (size_t i = 0; i < img1.size(); i++) {
-        uint8_t b1 = (img1[i] >> 16) & 0xFF;
-        uint8_t g1 = (img1[i] >> 8) & 0xFF;
-        uint8_t r1 = img1[i] & 0xFF;
-        uint8_t b2 = (img2[i] >> 16) & 0xFF;
-        uint8_t g2 = (img2[i] >> 8) & 0xFF;
-        uint8_t r2 = img2[i] & 0xFF;
-        meanSquareError += pow(r1 - r2, 2) + pow(g1 - g2, 2) + pow(b1 - b2, 2);
-    }
-    return meanSquareError / (3 * img1.size());
-}
-
-static COLORREF getAveragePixel(std::vector<uint32_t>& img1) {
-    double r = 0, g = 0, b = 0;
-    double meanSquareError = 0;
-    for (size_t i = 0; i < img1.size(); i++) {
-        b += (img1[i] >> 16) & 0xFF;
-        g += (img1[i] >> 8) & 0xFF;
-        r += img1[i] & 0xFF;
-    }
-    b /= img1.size();
-    g /= img1.size();
-    r /= img1.size();
-    return RGB(r, g, b);
-}
-
 static wchar_t getListDelimiter() {
     WCHAR delimiter[4];
     GetLocaleInfoW(LOCALE_USER_DEFAULT, LOCALE_SLIST, delimiter, 4);
     return delimiter[0];
 }
 
-static std::wstring formatCaptureItemTimestamp(const CaptureItem& item) {
-    std::wstringstream ss;
-    ss << std::setfill(L'0') << std::setw(4) << item.stTimestamp.wYear << L"-" << std::setw(2) << item.stTimestamp.wMonth << L"-"
-       << std::setw(2) << item.stTimestamp.wDay << L" " << std::setw(2) << item.stTimestamp.wHour << L":" << std::setw(2)
-       << item.stTimestamp.wMinute << L":" << std::setw(2) << item.stTimestamp.wSecond;
-    return ss.str();
-}
-
-static std::wstring formatCaptureItemColor(const CaptureItem& item) {
-    std::wstringstream ss;
-    ss << "#" << std::setfill(L'0') << std::hex << std::uppercase << std::setw(6) << item.cAvgColor;
-    return ss.str();
-}
-
-static std::wstring formatCaptureItem(const CaptureItem& item) {
-    std::wstringstream ss;
-    ss << std::setfill(L'0') << std::setw(4) << item.stTimestamp.wYear << L"-" << std::setw(2) << item.stTimestamp.wMonth << L"-"
-       << std::setw(2) << item.stTimestamp.wDay << L" " << std::setw(2) << item.stTimestamp.wHour << L":" << std::setw(2)
-       << item.stTimestamp.wMinute << L":" << std::setw(2) << item.stTimestamp.wSecond << L" - " << std::hex << std::setw(6)
-       << std::uppercase << item.cAvgColor;
-    return ss.str();
-}
-
 std::string getUtf8(const std::wstring& wstr) {
     if (wstr.empty())
         return std::string();
@@ -99,19 +62,45 @@ std::string getUtf8(const std::wstring& wstr) {
     return res;
 }
 
-static void writeCaptureLine(std::ofstream& file, const CaptureItem& item, std::string delimiter) {
-    file << '"' << getUtf8(formatCaptureItemTimestamp(item)) << '"' << delimiter << '"' << getUtf8(formatCaptureItemColor(item)) << '"'
-         << delimiter << (unsigned int)GetRValue(item.cAvgColor) << delimiter << (unsigned int)GetGValue(item.cAvgColor) << delimiter
-         << (unsigned int)GetBValue(item.cAvgColor) << std::endl;
+static std::wstring getRegionFileName(const std::wstring& fileName, const std::wstring& regionName) {
+    // Inserts the region name before the extension
+    const auto separator = fileName.find_last_of(L"\\/");
+    const auto dot = fileName.find_last_of(L'.');
+    if (dot == std::wstring::npos || (separator != std::wstring::npos && dot < separator)) {
+        return fileName + L" - " + regionName;
+    }
+    return fileName.substr(0, dot) + L" - " + regionName + fileName.substr(dot);
 }
 
-static int64_t getFileTimeDiff(const FILETIME& ft1, const FILETIME& ft2) {
-    ULARGE_INTEGER uli1, uli2;
-    uli1.LowPart = ft1.dwLowDateTime;
-    uli1.HighPart = ft1.dwHighDateTime;
-    uli2.LowPart = ft2.dwLowDateTime;
-    uli2.HighPart = ft2.dwHighDateTime;
-    return ((int64_t)uli1.QuadPart) - ((int64_t)uli2.QuadPart);
+static bool isBinaryLogFile(const std::wstring& fileName) {
+    const std::wstring extension = L".cglog";
+    return fileName.size() >= extension.size() &&
+           lstrcmpiW(fileName.c_str() + fileName.size() - extension.size(), extension.c_str()) == 0;
+}
+
+static void writeCaptureFile(const std::wstring& fileName, const CaptureItemModel& items, uint32_t region, bool allRegions) {
+    // The item list doesn't keep the frame statistics; only continuous binary logs have them
+    if (isBinaryLogFile(fileName)) {
+        auto logFile = BinaryLogWriter::Create(fileName, false);
+        if (!logFile) {
+            return;
+        }
+        for (size_t i = 0; i < items.GetRowCount(); i++) {
+            if (allRegions || items.GetRow(i).iRegion == region) {
+                logFile->Append(items.GetItem(i));
+            }
+        }
+        return;
+    }
+    auto csvFile = CaptureCsvWriter::Create(fileName, getUtf8(std::wstring(1, getListDelimiter())), false);
+    if (!csvFile) {
+        return;
+    }
+    for (size_t i = 0; i < items.GetRowCount(); i++) {
+        if (allRegions || items.GetRow(i).iRegion == region) {
+            csvFile->Append(items.GetItem(i));
+        }
+    }
 }
 
 //--------------------------------------------------------------------------------------------
@@ -123,22 +112,49 @@ std::shared_ptr<MainWindow> MainWindow::Create(LPCWSTR szTitle) {
 }
 
 MainWindow::MainWindow(LPCWSTR szTitle)
-    : hCurrentFont(NULL)
+    : hTelemetryView(NULL)
+    , qCaptureEvents(1024)
+    , cePendingStatus()
+    , bStatusPending(false)
+    , bEventsPosted(false)
+    , hCurrentFont(NULL)
     , csCapStatus(CaptureStatus::NotStarted)
-    , iStillImageDuration(3000) {
+    , iStillImageDuration(3000)
+    , iSampleBudget(0)
+    , bTileSignatures(false)
+    , rmReference(ReferenceMode::Frame)
+    , bPublishResults(false) {
+    // Spilled items live as long as the window, in a directory of their own per process
+    WCHAR tempPath[MAX_PATH];
+    const DWORD tempLength = GetTempPathW(MAX_PATH, tempPath);
+    if (tempLength > 0 && tempLength < MAX_PATH) {
+        RetentionPolicy retention;
+        retention.iMaxRows = RETAINED_ITEMS;
+        retention.iMaxAge = RETAINED_HOURS * 3600 * FILE_TIME_TO_SECONDS;
+        cimColorItems.SetRetention(retention, std::wstring(tempPath) + L"CapGraph-" + std::to_wstring(GetCurrentProcessId()));
+    }
     // Creates the main window
     hWindow = CreateWindowExW(WS_EX_OVERLAPPEDWINDOW | WS_EX_APPWINDOW, MainWindow::szClassName, szTitle, WS_OVERLAPPEDWINDOW,
                               CW_USEDEFAULT, 0, CW_USEDEFAULT, 0, nullptr, nullptr, MainWindow::hInstance, this);
     // Creates the child controls
     hStatusBar = CreateWindowExW(0, STATUSCLASSNAMEW, nullptr, SBARS_SIZEGRIP | SBARS_TOOLTIPS | WS_VISIBLE | WS_CHILD, 0, 0, 0, 0,
                                  hWindow, (HMENU)SID_STATUSBAR, MainWindow::hInstance, nullptr);
-    hlvDataList = CreateWindowExW(0, WC_LISTVIEWW, nullptr, WS_CHILD | WS_VISIBLE | WS_BORDER | LVS_REPORT | LVS_SINGLESEL, 0, 0, 0, 0,
+    hlvDataList = CreateWindowExW(0, WC_LISTVIEWW, nullptr,
+                                  WS_CHILD | WS_VISIBLE | WS_BORDER | LVS_REPORT | LVS_SINGLESEL | LVS_OWNERDATA, 0, 0, 0, 0,
                                   hWindow, (HMENU)LID_DATALIST, MainWindow::hInstance, nullptr);
     htbToolbar = CreateWindowExW(0, TOOLBARCLASSNAMEW, nullptr, WS_CHILD | WS_VISIBLE | TBSTYLE_FLAT | CCS_NODIVIDER, 0, 0, 0, 0,
                                  hWindow, (HMENU)TID_MAINTOOLBAR, MainWindow::hInstance, nullptr);
     pAreaSelector = RectWindow::Create();
     pAreaSelector->OnSetCaptureRect = [this](const RECT& rect) {
-        UNREFERENCED_PARAMETER(rect);
+        bool replace = true;
+        if (!vRegions.empty()) {
+            int msgResult = MessageBoxW(hWindow,
+                                        L"Deseja adicionar a \u00E1rea como uma nova regi\u00E3o?\n\n"
+                                        L"Sim: adiciona uma regi\u00E3o\nN\u00E3o: substitui as regi\u00F5es atuais",
+                                        L"Nova regi\u00E3o", MB_YESNO | MB_ICONQUESTION);
+            replace = msgResult == IDNO;
+        }
+        AddRegion(rect, replace);
         SendMessageW(htbToolbar, TB_ENABLEBUTTON, BID_STARTREC, TRUE);
     };
     // Sets up the toolbar
@@ -169,23 +185,62 @@ void MainWindow::SelectAreaClick() {
     }
 }
 
+void MainWindow::AddRegion(const RECT& area, bool replace) {
+    if (replace) {
+        vRegions.clear();
+    }
+    const auto id = (uint32_t)vRegionNames.size();
+    std::wostringstream name;
+    name << L"Regi\u00E3o " << id + 1;
+    vRegionNames.push_back(name.str());
+    // Keeps the GDI surfaces and frame buffers for as long as the region exists
+    vRegions.push_back(CaptureRegion::Create(id, name.str(), area));
+    Redraw();
+}
+
 void MainWindow::ToggleCaptureClick() {
     TBBUTTONINFOW tbi;
     tbi.cbSize = sizeof(TBBUTTONINFOW);
     tbi.dwMask = TBIF_TEXT | TBIF_IMAGE;
     if (csCapStatus != CaptureStatus::NotStarted) {
+        cwCaptureWorker.Stop();
+        KillTimer(hWindow, TID_STATUSUPDATE);
+        for (auto& region : vRegions) {
+            region->GetEngine().Stop();
+            region->SetRecorder(nullptr);
+            region->SetLog(nullptr);
+            region->SetPublisher(nullptr);
+        }
         csCapStatus = CaptureStatus::NotStarted;
-        KillTimer(hWindow, TID_CAPTURE);
+        // Shows whatever the worker produced before stopping, so nothing turns up late in the next capture
+        FlushAllCaptureEvents();
+        UpdateTelemetryView();
         tbi.iImage = MAKELONG(1, 0);
         tbi.pszText = L"Iniciar Captura";
         SendMessageW(htbToolbar, TB_SETBUTTONINFOW, BID_STARTREC, (LPARAM)&tbi);
     } else if (pAreaSelector) {
-        if (!pAreaSelector->HasSelectedArea()) {
+        if (vRegions.empty()) {
             MessageBoxW(hWindow, L"Por favor selecione uma regi\u00E3o para captura", NULL, MB_OK | MB_ICONERROR);
             return;
         }
+        rmReference = bTileSignatures ? ReferenceMode::TileSignatures : ReferenceMode::Frame;
+        for (auto& region : vRegions) {
+            region->SetReferenceMode(rmReference);
+            region->GetEngine().Start();
+        }
+        StartRecording();
+        StartLogging();
+        StartPublishing();
         csCapStatus = CaptureStatus::StillImage;
-        SetTimer(hWindow, TID_CAPTURE, 100, NULL);
+        scCaptureScheduler.Reset();
+        ctTelemetry.Reset();
+        cwCaptureWorker.Start([this](const CaptureWorker::TickTiming& timing) {
+            scCaptureScheduler.RecordTick(timing.tpScheduled, timing.tpStarted);
+            DoCapture();
+            ctTelemetry.RecordTick(timing.tpScheduled, timing.tpStarted, CaptureTelemetry::Clock::now(), timing.iSkippedTicks);
+            return scCaptureScheduler.NextInterval(csCapStatus, GetStillTimeRemaining());
+        });
+        SetTimer(hWindow, TID_STATUSUPDATE, STATUS_UPDATE_INTERVAL, NULL);
         tbi.iImage = MAKELONG(2, 0);
         tbi.pszText = L"Parar Captura";
         SendMessageW(htbToolbar, TB_SETBUTTONINFOW, BID_STARTREC, (LPARAM)&tbi);
@@ -197,8 +252,8 @@ void MainWindow::ClearDataClick() {
     if (result == IDNO) {
         return;
     }
-    SendMessageW(hlvDataList, LVM_DELETEALLITEMS, 0, 0);
-    vColorItems.clear();
+    cimColorItems.Clear();
+    SendMessageW(hlvDataList, LVM_SETITEMCOUNT, 0, 0);
     SendMessageW(htbToolbar, TB_ENABLEBUTTON, BID_CLEARDATA, FALSE);
     SendMessageW(htbToolbar, TB_ENABLEBUTTON, BID_SAVEDATA, FALSE);
 }
@@ -209,90 +264,306 @@ void MainWindow::SaveDataClick() {
     ZeroMemory(&ofn, sizeof(ofn));
     ofn.lStructSize = sizeof(ofn);
     ofn.hwndOwner = hWindow;
-    ofn.lpstrFilter = L"Valores Separados por V\u00EDrgula (*.csv)\0*.csv\0Todos os Arquivos (*.*)\0*.*\0";
+    ofn.lpstrFilter = L"Valores Separados por V\u00EDrgula (*.csv)\0*.csv\0Log Bin\u00E1rio (*.cglog)\0*.cglog\0"
+                      L"Todos os Arquivos (*.*)\0*.*\0";
     ofn.lpstrFile = szFileName;
     ofn.nMaxFile = MAX_PATH;
     ofn.Flags = OFN_EXPLORER | OFN_OVERWRITEPROMPT;
     ofn.lpstrDefExt = L"csv";
     if (GetSaveFileNameW(&ofn)) {
-        std::ofstream csvFile(ofn.lpstrFile);
-        const auto delimiter = getUtf8(std::wstring(1, getListDelimiter()));
-        csvFile.write((const char*)utf8BOM, 3);
-        csvFile << "Timestamp" << delimiter << "Cor" << delimiter << "R" << delimiter << "G" << delimiter << "B" << std::endl;
-        for (const auto& item : vColorItems) {
-            writeCaptureLine(csvFile, item, delimiter);
+        // Each region gets its own file when the data came from more than one region
+        std::vector<uint8_t> logged(vRegionNames.size(), 0);
+        size_t loggedCount = 0;
+        for (size_t i = 0; i < cimColorItems.GetRowCount(); i++) {
+            const auto region = cimColorItems.GetRow(i).iRegion;
+            if (!logged[region]) {
+                logged[region] = 1;
+                loggedCount++;
+            }
+        }
+        if (loggedCount <= 1) {
+            writeCaptureFile(ofn.lpstrFile, cimColorItems, 0, true);
+            return;
+        }
+        for (uint32_t region = 0; region < logged.size(); region++) {
+            if (logged[region]) {
+                writeCaptureFile(getRegionFileName(ofn.lpstrFile, vRegionNames[region]), cimColorItems, region, false);
+            }
+        }
+    }
+}
+
+void MainWindow::RecordFramesClick() {
+    if (!sRecordingPath.empty()) {
+        sRecordingPath.clear();
+        return;
+    }
+    OPENFILENAMEW ofn;
+    WCHAR szFileName[MAX_PATH] = L"";
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hWindow;
+    ofn.lpstrFilter = L"Quadros Gravados (*.cgrf)\0*.cgrf\0Todos os Arquivos (*.*)\0*.*\0";
+    ofn.lpstrFile = szFileName;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.Flags = OFN_EXPLORER | OFN_OVERWRITEPROMPT;
+    ofn.lpstrDefExt = L"cgrf";
+    if (GetSaveFileNameW(&ofn)) {
+        // Takes effect when the next capture starts
+        sRecordingPath = ofn.lpstrFile;
+    }
+}
+
+void MainWindow::StartRecording() {
+    if (sRecordingPath.empty()) {
+        return;
+    }
+    for (auto& region : vRegions) {
+        auto& session = region->GetSession();
+        const auto fileName = vRegions.size() > 1 ? getRegionFileName(sRecordingPath, region->GetName()) : sRecordingPath;
+        auto recorder = FrameFileWriter::Create(fileName, session.GetWidth(), session.GetHeight());
+        if (!recorder) {
+            MessageBoxW(hWindow, (L"N\u00E3o foi poss\u00EDvel criar o arquivo " + fileName).c_str(), NULL, MB_OK | MB_ICONERROR);
         }
-        csvFile.close();
+        region->SetRecorder(recorder);
     }
 }
 
-void MainWindow::DoCapture() {
-    if (!pAreaSelector) {
+void MainWindow::ContinuousLogClick() {
+    if (!sLogPath.empty()) {
+        sLogPath.clear();
         return;
     }
-    const auto area = pAreaSelector->GetCaptureRect();
+    OPENFILENAMEW ofn;
+    WCHAR szFileName[MAX_PATH] = L"";
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hWindow;
+    ofn.lpstrFilter = L"Valores Separados por V\u00EDrgula (*.csv)\0*.csv\0Todos os Arquivos (*.*)\0*.*\0";
+    ofn.lpstrFile = szFileName;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.Flags = OFN_EXPLORER;
+    ofn.lpstrDefExt = L"csv";
+    if (GetSaveFileNameW(&ofn)) {
+        // Takes effect when the next capture starts; existing files are appended to
+        sLogPath = ofn.lpstrFile;
+    }
+}
+
+void MainWindow::StartLogging() {
+    if (sLogPath.empty()) {
+        return;
+    }
+    const auto delimiter = getUtf8(std::wstring(1, getListDelimiter()));
+    for (auto& region : vRegions) {
+        const auto fileName = vRegions.size() > 1 ? getRegionFileName(sLogPath, region->GetName()) : sLogPath;
+        auto log = CaptureCsvWriter::Create(fileName, delimiter, true);
+        if (!log) {
+            MessageBoxW(hWindow, (L"N\u00E3o foi poss\u00EDvel abrir o arquivo " + fileName).c_str(), NULL, MB_OK | MB_ICONERROR);
+        }
+        region->SetLog(log);
+    }
+}
+
+void MainWindow::StartPublishing() {
+    if (!bPublishResults) {
+        return;
+    }
+    // One ring for every region, told apart by the region id of the entries
+    auto ring = SharedRingWriter::Create(DEFAULT_RING_NAME, true);
+    if (!ring) {
+        MessageBoxW(hWindow, L"N\u00E3o foi poss\u00EDvel publicar os resultados: outra captura j\u00E1 os publica", NULL,
+                    MB_OK | MB_ICONERROR);
+    }
+    for (auto& region : vRegions) {
+        region->SetPublisher(ring);
+    }
+}
+
+void MainWindow::DoCapture() {
+    // Blits from the screen are serialized by GDI anyway, so only the analysis is spread over the pool
     const auto dpi = GetDpiForWindow(hWindow);
-    const auto imWidth = (area.right - area.left);
-    const auto imHeight = (area.bottom - area.top);
-    // Draws image on window
-    HDC screen = GetDC(NULL);
     HDC winDc = GetDC(hWindow);
-    BitBlt(winDc, ScaleToDPI(310, dpi), ScaleToDPI(45, dpi), imWidth, imHeight, screen, area.left, area.top, SRCCOPY);
-    // Reads image from screen
-    HDC memDc = CreateCompatibleDC(winDc);
-    HBITMAP hBitmap = CreateCompatibleBitmap(winDc, imWidth, imHeight);
-    BITMAPINFOHEADER bihHeader = {0};
-    std::vector<uint32_t> newImage(imWidth * imHeight);
-    bihHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bihHeader.biWidth = imWidth;
-    bihHeader.biHeight = imHeight;
-    bihHeader.biPlanes = 1;
-    bihHeader.biBitCount = 32;
-    bihHeader.biCompression = BI_RGB;
-    bihHeader.biSizeImage = 0;
-    bihHeader.biXPelsPerMeter = 0;
-    bihHeader.biYPelsPerMeter = 0;
-    bihHeader.biClrUsed = 0;
-    bihHeader.biClrImportant = 0;
-    SelectObject(memDc, hBitmap);
-    BitBlt(memDc, 0, 0, imWidth, imHeight, screen, area.left, area.top, SRCCOPY);
-    GetDIBits(winDc, hBitmap, 0, imHeight, newImage.data(), (LPBITMAPINFO)&bihHeader, DIB_RGB_COLORS);
-    // Compare if frames changed
-    double diff = compareImages(vCaptureBuffer, newImage);
-    bool imageChanged = diff > 0.01;
-    if (csCapStatus == CaptureStatus::WaitingStillImage) {
-        FILETIME ftNow;
-        GetSystemTimeAsFileTime(&ftNow);
-        if (imageChanged) {
-            ftLastChangedImage = ftNow;
-        } else if (getFileTimeDiff(ftNow, ftLastChangedImage) > iStillImageDuration * FILE_TIME_TO_MILLISECONDS) {
-            csCapStatus = CaptureStatus::StillImage;
-            CaptureItem newItem;
-            SYSTEMTIME stUtcTimestamp;
-            FileTimeToSystemTime(&ftNow, &stUtcTimestamp);
-            SystemTimeToTzSpecificLocalTime(NULL, &stUtcTimestamp, &newItem.stTimestamp);
-            newItem.cAvgColor = getAveragePixel(newImage);
-            InsertCaptureItem(newItem);
-            auto statusText = formatCaptureItem(newItem);
-            SendMessageW(hStatusBar, SB_SETTEXTW, 0, (LPARAM)statusText.c_str());
-        }
-    } else if (csCapStatus == CaptureStatus::StillImage) {
-        if (imageChanged) {
-            FILETIME ftNow;
-            GetSystemTimeAsFileTime(&ftNow);
-            ftLastChangedImage = ftNow;
-            csCapStatus = CaptureStatus::WaitingStillImage;
-            std::wostringstream statusText;
-            statusText << L"Esperando imagem... (" << diff << L")";
-            SendMessageW(hStatusBar, SB_SETTEXTW, 0, (LPARAM)statusText.str().c_str());
+    int previewY = ScaleToDPI(45, dpi);
+    for (auto& region : vRegions) {
+        const auto grabStart = CaptureTelemetry::Clock::now();
+        const bool grabbed = region->Grab();
+        ctTelemetry.Record(CaptureStage::Grab, CaptureTelemetry::Clock::now() - grabStart);
+        if (grabbed) {
+            // Draws image on window, from the same grab used for the analysis
+            region->GetSession().DrawPreview(winDc, ScaleToDPI(DATA_LIST_WIDTH + 10, dpi), previewY);
         }
+        previewY += region->GetSession().GetHeight() + ScaleToDPI(10, dpi);
     }
-    // Stores the new image
-    vCaptureBuffer = std::move(newImage);
-    DeleteObject(hBitmap);
-    ReleaseDC(NULL, screen);
     ReleaseDC(hWindow, winDc);
-    ReleaseDC(hWindow, memDc);
+    const int64_t now = getCurrentFileTime();
+    EngineSettings settings;
+    settings.iStillDuration = iStillImageDuration * FILE_TIME_TO_MILLISECONDS;
+    settings.iSampleBudget = iSampleBudget;
+    settings.pTelemetry = &ctTelemetry;
+    settings.rmReference = rmReference;
+    tpRegionPool.ParallelFor(vRegions.size(), [this, now, &settings](size_t i) { vRegions[i]->Analyze(now, settings); });
+    // Events are posted from this thread only, in region order
+    bool waiting = false;
+    for (auto& region : vRegions) {
+        if (region->GetEngine().GetTracker().GetStatus() == CaptureStatus::WaitingStillImage) {
+            waiting = true;
+        }
+        if (region->HasEvent()) {
+            PostCaptureEvent(CaptureEvent(region->GetEvent()));
+        }
+    }
+    csCapStatus = waiting ? CaptureStatus::WaitingStillImage : CaptureStatus::StillImage;
+    FlushCaptureEvents();
+}
+
+CaptureScheduler::Clock::duration MainWindow::GetStillTimeRemaining() const {
+    const int64_t now = getCurrentFileTime();
+    const int64_t stillDuration = iStillImageDuration * FILE_TIME_TO_MILLISECONDS;
+    // The next tick is due when the first waiting region qualifies
+    int64_t remaining = -1;
+    for (const auto& region : vRegions) {
+        const auto& tracker = region->GetEngine().GetTracker();
+        if (tracker.GetStatus() == CaptureStatus::WaitingStillImage) {
+            const auto regionRemaining = tracker.GetStillTimeRemaining(now, stillDuration);
+            remaining = remaining < 0 ? regionRemaining : (std::min)(remaining, regionRemaining);
+        }
+    }
+    if (remaining < 0) {
+        return CaptureScheduler::Clock::duration::zero();
+    }
+    // FILETIME counts 100 ns intervals
+    return std::chrono::duration_cast<CaptureScheduler::Clock::duration>(std::chrono::nanoseconds(remaining * 100));
+}
+
+void MainWindow::UpdateRateStatus() {
+    const auto stats = scCaptureScheduler.GetStats();
+    std::wostringstream text;
+    text << std::fixed << std::setprecision(1) << stats.dEffectiveFps << L" fps, jitter " << stats.dMeanJitterMs << L" ms (m\u00E1x "
+         << stats.dMaxJitterMs << L" ms)";
+    SendMessageW(hStatusBar, SB_SETTEXTW, 1, (LPARAM)text.str().c_str());
+}
+
+void MainWindow::LiveTelemetryClick() {
+    if (hTelemetryView && IsWindow(hTelemetryView)) {
+        DestroyWindow(hTelemetryView);
+        hTelemetryView = NULL;
+        return;
+    }
+    // A read only edit box is enough to show the report table, and closes by itself
+    const auto dpi = GetDpiForWindow(hWindow);
+    hTelemetryView = CreateWindowExW(WS_EX_TOOLWINDOW, L"EDIT", L"Telemetria",
+                                     WS_OVERLAPPEDWINDOW | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL | ES_MULTILINE | ES_READONLY,
+                                     CW_USEDEFAULT, 0, ScaleToDPI(640, dpi), ScaleToDPI(260, dpi), hWindow, NULL,
+                                     MainWindow::hInstance, nullptr);
+    if (hTelemetryView) {
+        SendMessageW(hTelemetryView, WM_SETFONT, (WPARAM)GetStockObject(ANSI_FIXED_FONT), FALSE);
+        UpdateTelemetryView();
+    }
+}
+
+void MainWindow::SaveTelemetryClick() {
+    OPENFILENAMEW ofn;
+    WCHAR szFileName[MAX_PATH] = L"";
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hWindow;
+    ofn.lpstrFilter = L"Texto (*.txt)\0*.txt\0Todos os Arquivos (*.*)\0*.*\0";
+    ofn.lpstrFile = szFileName;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.Flags = OFN_EXPLORER | OFN_OVERWRITEPROMPT;
+    ofn.lpstrDefExt = L"txt";
+    if (GetSaveFileNameW(&ofn)) {
+        std::ofstream file(ofn.lpstrFile);
+        writeTelemetryReport(file, ctTelemetry.GetSnapshot(), true);
+        if (!file) {
+            MessageBoxW(hWindow, (L"N\u00E3o foi poss\u00EDvel salvar o arquivo " + std::wstring(ofn.lpstrFile)).c_str(), NULL,
+                        MB_OK | MB_ICONERROR);
+        }
+    }
+}
+
+void MainWindow::UpdateTelemetryView() {
+    if (!hTelemetryView || !IsWindow(hTelemetryView)) {
+        hTelemetryView = NULL;
+        return;
+    }
+    // The report is ASCII; edit boxes break lines on CR LF only
+    const auto report = formatTelemetryReport(ctTelemetry.GetSnapshot(), false);
+    std::wstring text;
+    text.reserve(report.size() + 32);
+    for (const char c : report) {
+        if (c == '\n') {
+            text += L'\r';
+        }
+        text += (wchar_t)c;
+    }
+    SetWindowTextW(hTelemetryView, text.c_str());
+}
+
+void MainWindow::PostCaptureEvent(CaptureEvent&& event) {
+    if (event.seType == StillnessEvent::StillImage) {
+        // The still image replaces any earlier status on the status bar
+        dqPendingEvents.push_back(std::move(event));
+        bStatusPending = false;
+    } else {
+        cePendingStatus = std::move(event);
+        bStatusPending = true;
+    }
+}
+
+void MainWindow::FlushCaptureEvents() {
+    // Events that don't fit in the queue wait on the worker side until the UI thread catches up. The pending status came
+    // after every pending still image, so it goes last.
+    bool pushed = false;
+    while (!dqPendingEvents.empty() && qCaptureEvents.TryPush(dqPendingEvents.front())) {
+        dqPendingEvents.pop_front();
+        pushed = true;
+    }
+    if (dqPendingEvents.empty() && bStatusPending && qCaptureEvents.TryPush(cePendingStatus)) {
+        bStatusPending = false;
+        pushed = true;
+    }
+    if (pushed && !bEventsPosted.exchange(true)) {
+        PostMessageW(hWindow, WM_CAPTURE_EVENTS, 0, 0);
+    }
+}
+
+void MainWindow::FlushAllCaptureEvents() {
+    while (!dqPendingEvents.empty() || bStatusPending || !qCaptureEvents.IsEmpty()) {
+        FlushCaptureEvents();
+        DrainCaptureEvents();
+    }
+}
+
+void MainWindow::DrainCaptureEvents() {
+    bEventsPosted = false;
+    std::wstring statusText;
+    std::vector<CaptureItem> items;
+    auto handled = qCaptureEvents.Drain(
+        [this, &statusText, &items](CaptureEvent& event) {
+            std::wostringstream text;
+            if (vRegionNames.size() > 1) {
+                text << vRegionNames[event.ciItem.iRegion] << L": ";
+            }
+            if (event.seType == StillnessEvent::StillImage) {
+                items.push_back(event.ciItem);
+                wchar_t itemText[CAPTURE_ITEM_MAX_LENGTH];
+                text.write(itemText, formatCaptureItem(event.ciItem, itemText) - itemText);
+            } else {
+                text << L"Esperando imagem... (" << event.dDiff << L")";
+            }
+            statusText = text.str();
+        },
+        CAPTURE_EVENTS_BATCH);
+    InsertCaptureItems(items.data(), items.size());
+    // Only the latest status of the batch is worth showing
+    if (!statusText.empty()) {
+        SendMessageW(hStatusBar, SB_SETTEXTW, 0, (LPARAM)statusText.c_str());
+    }
+    if (handled == CAPTURE_EVENTS_BATCH && !bEventsPosted.exchange(true)) {
+        PostMessageW(hWindow, WM_CAPTURE_EVENTS, 0, 0);
+    }
 }
 
 void MainWindow::GetMinMaxInfo(LPMINMAXINFO minMaxInfo) {
@@ -357,27 +628,48 @@ void MainWindow::SetupToolbarImages() {
     }
 }
 
-void MainWindow::InsertCaptureItem(const CaptureItem& item) {
-    auto listSize = (int)SendMessageW(hlvDataList, LVM_GETITEMCOUNT, 0, 0);
-    auto timestamp = formatCaptureItemTimestamp(item);
-    auto color = formatCaptureItemColor(item);
-    LVITEMW lvItem;
-    lvItem.mask = LVIF_TEXT | LVIF_STATE;
-    lvItem.state = 0;
-    lvItem.stateMask = 0;
-    lvItem.iSubItem = 0;
-    lvItem.iItem = listSize;
-    lvItem.pszText = (LPWSTR)timestamp.c_str();
-    auto index = (int)SendMessageW(hlvDataList, LVM_INSERTITEMW, 0, (LPARAM)&lvItem);
-    lvItem.iSubItem = 1;
-    lvItem.iItem = index;
-    lvItem.pszText = (LPWSTR)color.c_str();
-    SendMessageW(hlvDataList, LVM_SETITEMW, 0, (LPARAM)&lvItem);
-    vColorItems.push_back(item);
+void MainWindow::InsertCaptureItems(const CaptureItem* items, size_t count) {
+    if (!count) {
+        return;
+    }
+    const auto insertStart = CaptureTelemetry::Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        cimColorItems.Append(items[i]);
+    }
+    // The list is virtual: it only learns the new row count, and asks for the text of the rows it shows
+    SendMessageW(hlvDataList, LVM_SETITEMCOUNT, (WPARAM)cimColorItems.GetRowCount(), LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+    ctTelemetry.Record(CaptureStage::Insert, CaptureTelemetry::Clock::now() - insertStart);
     SendMessageW(htbToolbar, TB_ENABLEBUTTON, BID_CLEARDATA, TRUE);
     SendMessageW(htbToolbar, TB_ENABLEBUTTON, BID_SAVEDATA, TRUE);
 }
 
+void MainWindow::GetItemText(NMLVDISPINFOW* dispInfo) {
+    auto& lvItem = dispInfo->item;
+    if (!(lvItem.mask & LVIF_TEXT) || lvItem.cchTextMax <= 0 || lvItem.iItem < 0 ||
+        (size_t)lvItem.iItem >= cimColorItems.GetRowCount()) {
+        return;
+    }
+    const auto item = cimColorItems.GetItem((size_t)lvItem.iItem);
+    wchar_t buffer[CAPTURE_TIMESTAMP_MAX_LENGTH];
+    const wchar_t* text = buffer;
+    const wchar_t* end = buffer;
+    switch (lvItem.iSubItem) {
+    case 0:
+        end = formatCaptureItemTimestamp(item, buffer);
+        break;
+    case 1:
+        end = formatCaptureItemColor(item, buffer);
+        break;
+    case 2:
+        text = vRegionNames[item.iRegion].c_str();
+        end = text + vRegionNames[item.iRegion].size();
+        break;
+    }
+    const size_t length = (std::min)((size_t)(end - text), (size_t)lvItem.cchTextMax - 1);
+    std::copy(text, text + length, lvItem.pszText);
+    lvItem.pszText[length] = L'\0';
+}
+
 void MainWindow::SetupColumns() {
     const auto dpi = GetDpiForWindow(hWindow);
     LVCOLUMNW lvColumn;
@@ -387,10 +679,14 @@ void MainWindow::SetupColumns() {
     lvColumn.pszText = L"Timestamp";
     lvColumn.iSubItem = 0;
     SendMessageW(hlvDataList, LVM_INSERTCOLUMNW, 0, (LPARAM)&lvColumn);
-    lvColumn.cx = ScaleToDPI(100, dpi);
+    lvColumn.cx = ScaleToDPI(90, dpi);
     lvColumn.pszText = L"Cor M\u00E9dia";
     lvColumn.iSubItem = 1;
     SendMessageW(hlvDataList, LVM_INSERTCOLUMNW, 1, (LPARAM)&lvColumn);
+    lvColumn.cx = ScaleToDPI(90, dpi);
+    lvColumn.pszText = L"Regi\u00E3o";
+    lvColumn.iSubItem = 2;
+    SendMessageW(hlvDataList, LVM_INSERTCOLUMNW, 2, (LPARAM)&lvColumn);
 }
 
 void MainWindow::UpdateChildrenPos(LPRECT clientArea) {
@@ -398,9 +694,12 @@ void MainWindow::UpdateChildrenPos(LPRECT clientArea) {
     if (dpi) {
         RECT statusBarPos;
         SendMessageW(hStatusBar, WM_SIZE, 0, 0);
+        // The right part shows the capture rate
+        int statusParts[] = {(std::max)(0, (int)(clientArea->right - clientArea->left) - ScaleToDPI(250, dpi)), -1};
+        SendMessageW(hStatusBar, SB_SETPARTS, 2, (LPARAM)statusParts);
         GetWindowRect(hStatusBar, &statusBarPos);
         auto statusBarHeight = statusBarPos.bottom - statusBarPos.top;
-        SetWindowPos(hlvDataList, NULL, 0, ScaleToDPI(45, dpi), ScaleToDPI(300, dpi),
+        SetWindowPos(hlvDataList, NULL, 0, ScaleToDPI(45, dpi), ScaleToDPI(DATA_LIST_WIDTH, dpi),
                      clientArea->bottom - clientArea->top - statusBarHeight - ScaleToDPI(45, dpi), SWP_NOZORDER | SWP_NOACTIVATE);
     }
 }
@@ -423,7 +722,9 @@ void MainWindow::UpdateFont() {
 }
 
 void MainWindow::DestroyCleanup() {
+    cwCaptureWorker.Stop();
     hWindow = 0;
+    vRegions.clear();
     if (hCurrentFont) {
         DeleteObject(hCurrentFont);
         hCurrentFont = 0;
@@ -465,11 +766,38 @@ LRESULT MainWindow::HandleMessage(UINT message, WPARAM wParam, LPARAM lParam) {
         case IDM_STILL_DURATION_100:
             iStillImageDuration = 10000;
             return 0;
+        case IDM_SAMPLED_AVERAGE:
+            iSampleBudget = iSampleBudget ? 0 : DEFAULT_SAMPLE_BUDGET;
+            return 0;
+        case IDM_TILE_SIGNATURES:
+            // Takes effect when the next capture starts, since the capture surfaces depend on it
+            bTileSignatures = !bTileSignatures;
+            return 0;
+        case IDM_RECORD_FRAMES:
+            RecordFramesClick();
+            return 0;
+        case IDM_CONTINUOUS_LOG:
+            ContinuousLogClick();
+            return 0;
+        case IDM_PUBLISH_RESULTS:
+            // Takes effect when the next capture starts
+            bPublishResults = !bPublishResults;
+            return 0;
+        case IDM_LIVE_TELEMETRY:
+            LiveTelemetryClick();
+            return 0;
+        case IDM_SAVE_TELEMETRY:
+            SaveTelemetryClick();
+            return 0;
         }
         break;
     }
     case WM_NOTIFY: {
         LPNMHDR nmhdr = (LPNMHDR)lParam;
+        if (nmhdr->idFrom == LID_DATALIST && nmhdr->code == LVN_GETDISPINFOW) {
+            GetItemText((NMLVDISPINFOW*)lParam);
+            return 0;
+        }
         if (nmhdr->idFrom == TID_MAINTOOLBAR && nmhdr->code == TBN_DROPDOWN) {
             LPNMTOOLBARW nmtb = (LPNMTOOLBARW)lParam;
             RECT buttonRect;
@@ -504,6 +832,13 @@ LRESULT MainWindow::HandleMessage(UINT message, WPARAM wParam, LPARAM lParam) {
                 break;
             }
             CheckMenuItem(hPopupMenu, IDM_STILL_DURATION_05, MF_BYCOMMAND | (iStillImageDuration == 500 ? MF_CHECKED : MF_UNCHECKED));
+            CheckMenuItem(hPopupMenu, IDM_SAMPLED_AVERAGE, MF_BYCOMMAND | (iSampleBudget ? MF_CHECKED : MF_UNCHECKED));
+            CheckMenuItem(hPopupMenu, IDM_TILE_SIGNATURES, MF_BYCOMMAND | (bTileSignatures ? MF_CHECKED : MF_UNCHECKED));
+            CheckMenuItem(hPopupMenu, IDM_RECORD_FRAMES, MF_BYCOMMAND | (sRecordingPath.empty() ? MF_UNCHECKED : MF_CHECKED));
+            CheckMenuItem(hPopupMenu, IDM_CONTINUOUS_LOG, MF_BYCOMMAND | (sLogPath.empty() ? MF_UNCHECKED : MF_CHECKED));
+            CheckMenuItem(hPopupMenu, IDM_PUBLISH_RESULTS, MF_BYCOMMAND | (bPublishResults ? MF_CHECKED : MF_UNCHECKED));
+            CheckMenuItem(hPopupMenu, IDM_LIVE_TELEMETRY,
+                          MF_BYCOMMAND | (hTelemetryView && IsWindow(hTelemetryView) ? MF_CHECKED : MF_UNCHECKED));
             TrackPopupMenuEx(hPopupMenu, TPM_LEFTALIGN | TPM_LEFTBUTTON | TPM_VERTICAL, buttonRect.left, buttonRect.bottom, hWindow,
                              &tpm);
 
@@ -511,11 +846,16 @@ LRESULT MainWindow::HandleMessage(UINT message, WPARAM wParam, LPARAM lParam) {
         }
         break;
     }
+    case WM_CAPTURE_EVENTS:
+        DrainCaptureEvents();
+        return 0;
     case WM_TIMER:
-        if (wParam == TID_CAPTURE) {
-            DoCapture();
+        if (wParam == TID_STATUSUPDATE) {
+            UpdateRateStatus();
+            UpdateTelemetryView();
+            return 0;
         }
-        return 0;
+        break;
     case WM_WINDOWPOSCHANGED: {
         LPWINDOWPOS position = (LPWINDOWPOS)lParam;
         if ((position->flags & SWP_NOSIZE) == 0) {
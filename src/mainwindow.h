@@ -1,21 +1,22 @@
 #ifndef __CAPGRAPH_MAINWINDOW_H__
 #define __CAPGRAPH_MAINWINDOW_H__
+#include "captureitemmodel.h"
+#include "captureregion.h"
+#include "capturescheduler.h"
+#include "capturestatus.h"
+#include "capturetelemetry.h"
+#include "captureworker.h"
 #include "rectwindow.h"
+#include "spscqueue.h"
+#include "threadpool.h"
 #include "window.h"
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <string>
 #include <vector>
 #include <windows.h>
-
-enum class CaptureStatus {
-    NotStarted,
-    WaitingStillImage,
-    StillImage,
-};
-
-struct CaptureItem {
-    SYSTEMTIME stTimestamp;
-    COLORREF cAvgColor;
-};
+#include <CommCtrl.h>
 
 class MainWindow : public Window {
 public:
@@ -24,28 +25,73 @@ public:
     static void Register(HINSTANCE hInstance);
 
 private:
-    std::vector<CaptureItem> vColorItems;
+    CaptureItemModel cimColorItems;
     std::shared_ptr<RectWindow> pAreaSelector;
-    std::vector<uint32_t> vCaptureBuffer;
-    FILETIME ftLastChangedImage;
+    std::vector<std::shared_ptr<CaptureRegion>> vRegions;
+    // Names of every region created, indexed by region id, so logged items keep their region after it is replaced
+    std::vector<std::wstring> vRegionNames;
+    CaptureWorker cwCaptureWorker;
+    CaptureScheduler scCaptureScheduler;
+    ThreadPool tpRegionPool;
+    // Stage latencies and tick counters of the current capture
+    CaptureTelemetry ctTelemetry;
+    // Window showing the telemetry while it's open
+    HWND hTelemetryView;
+    SpscQueue<CaptureEvent> qCaptureEvents;
+    // Still images that didn't fit in the queue yet, kept on the worker side until the UI thread catches up. Status
+    // events are not kept there: only the latest one is worth showing, so it waits alone in cePendingStatus.
+    std::deque<CaptureEvent> dqPendingEvents;
+    CaptureEvent cePendingStatus;
+    bool bStatusPending;
+    std::atomic<bool> bEventsPosted;
     HWND hStatusBar;
     HWND hlvDataList;
     HWND htbToolbar;
     HFONT hCurrentFont;
-    CaptureStatus csCapStatus;
+    std::atomic<CaptureStatus> csCapStatus;
     INT_PTR iToolbarTextIdx;
-    int64_t iStillImageDuration;
+    std::atomic<int64_t> iStillImageDuration;
+    // Pixels sampled to average a still image, zero to read every pixel
+    std::atomic<size_t> iSampleBudget;
+    // Compares the frames with tile signatures instead of the previous frame, from the next capture on
+    bool bTileSignatures;
+    // Reference mode of the running capture
+    ReferenceMode rmReference;
+    // Every frame of the next captures is recorded to this file (compressed, see FrameFileWriter) when it is set
+    std::wstring sRecordingPath;
+    // Still images of the next captures are appended to this CSV file as they are recorded, when it is set
+    std::wstring sLogPath;
+    // Still images of the next captures are published, with their statistics, to the shared memory ring read by
+    // capgraph-watch and the dashboards
+    bool bPublishResults;
 
     void SelectAreaClick();
+    void AddRegion(const RECT& area, bool replace);
     void ToggleCaptureClick();
     void ClearDataClick();
     void SaveDataClick();
+    void RecordFramesClick();
+    void StartRecording();
+    void ContinuousLogClick();
+    void StartLogging();
+    void StartPublishing();
     void DoCapture();
+    CaptureScheduler::Clock::duration GetStillTimeRemaining() const;
+    void UpdateRateStatus();
+    void LiveTelemetryClick();
+    void SaveTelemetryClick();
+    void UpdateTelemetryView();
+    void PostCaptureEvent(CaptureEvent&& event);
+    void FlushCaptureEvents();
+    void DrainCaptureEvents();
+    // Hands every pending event to the UI, once the worker is stopped
+    void FlushAllCaptureEvents();
 
     void SetupToolbar();
     void SetupToolbarImages();
     void SetupColumns();
-    void InsertCaptureItem(const CaptureItem& item);
+    void InsertCaptureItems(const CaptureItem* items, size_t count);
+    void GetItemText(NMLVDISPINFOW* dispInfo);
 
     void GetMinMaxInfo(LPMINMAXINFO minMaxInfo);
     void UpdateChildrenPos(LPRECT clientArea);
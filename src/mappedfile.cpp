@@ -0,0 +1,92 @@
+#include "mappedfile.h"
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : pData(nullptr)
+    , iSize(0)
+#ifdef _WIN32
+    , hFile(INVALID_HANDLE_VALUE)
+    , hMapping(NULL)
+#else
+    , iDescriptor(-1)
+#endif
+{
+}
+
+#ifdef _WIN32
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+    const int size = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), (int)path.size(), nullptr, 0);
+    std::wstring widePath(size, 0);
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), (int)path.size(), &widePath[0], size);
+    return Open(widePath);
+}
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::wstring& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER size;
+    if (file->hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->hFile, &size)) {
+        return nullptr;
+    }
+    file->iSize = (size_t)size.QuadPart;
+    // Empty files can't be mapped, but are valid views
+    if (file->iSize == 0) {
+        return file;
+    }
+    file->hMapping = CreateFileMappingW(file->hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!file->hMapping) {
+        return nullptr;
+    }
+    file->pData = (const uint8_t*)MapViewOfFile(file->hMapping, FILE_MAP_READ, 0, 0, 0);
+    return file->pData ? file : nullptr;
+}
+
+MappedFile::~MappedFile() {
+    if (pData) {
+        UnmapViewOfFile(pData);
+    }
+    if (hMapping) {
+        CloseHandle(hMapping);
+    }
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+}
+#else
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->iDescriptor = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (file->iDescriptor < 0 || fstat(file->iDescriptor, &status) != 0) {
+        return nullptr;
+    }
+    file->iSize = (size_t)status.st_size;
+    // Empty files can't be mapped, but are valid views
+    if (file->iSize == 0) {
+        return file;
+    }
+    void* data = mmap(nullptr, file->iSize, PROT_READ, MAP_PRIVATE, file->iDescriptor, 0);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    file->pData = (const uint8_t*)data;
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (pData) {
+        munmap((void*)pData, iSize);
+    }
+    if (iDescriptor >= 0) {
+        close(iDescriptor);
+    }
+}
+#endif
@@ -0,0 +1,40 @@
+#ifndef __CAPGRAPH_MAPPEDFILE_H__
+#define __CAPGRAPH_MAPPEDFILE_H__
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Read only view of a whole file mapped in memory
+class MappedFile {
+public:
+    // Returns null when the file can't be opened or mapped
+    static std::shared_ptr<MappedFile> Open(const std::string& path);
+#ifdef _WIN32
+    static std::shared_ptr<MappedFile> Open(const std::wstring& path);
+#endif
+    ~MappedFile();
+
+    const uint8_t* GetData() const {
+        return pData;
+    }
+    size_t GetSize() const {
+        return iSize;
+    }
+
+private:
+    MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* pData;
+    size_t iSize;
+#ifdef _WIN32
+    void* hFile;
+    void* hMapping;
+#else
+    int iDescriptor;
+#endif
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __CAPGRAPH_PIXELFORMAT_H__
+#define __CAPGRAPH_PIXELFORMAT_H__
+#include <cstddef>
+#include <cstring>
+
+// Layouts of the frames the kernels read, named by their byte order in memory
+enum class PixelFormat {
+    // B, G, R, unused: what GetDIBits delivers for 32-bit BI_RGB bitmaps, and the layout of the frame recordings
+    BGRA32,
+    // R, G, B, unused
+    RGBA32,
+    // R, G, B
+    RGB24,
+    // Little endian 16-bit words with red in the top 5 bits and blue in the low 5 bits
+    RGB565,
+    // A single intensity, read as equal R, G and B
+    Gray8,
+};
+
+constexpr size_t getPixelSize(PixelFormat format) {
+    return format == PixelFormat::RGB24    ? 3
+           : format == PixelFormat::RGB565 ? 2
+           : format == PixelFormat::Gray8  ? 1
+                                           : 4;
+}
+
+static const char* const PIXEL_FORMAT_NAMES[] = {"bgra32", "rgba32", "rgb24", "rgb565", "gray8"};
+
+inline const char* getPixelFormatName(PixelFormat format) {
+    return PIXEL_FORMAT_NAMES[(int)format];
+}
+
+// Reads a format from its name, as given by getPixelFormatName. Returns false for unknown names.
+inline bool parsePixelFormat(const char* name, PixelFormat& format) {
+    for (int i = 0; i < (int)(sizeof(PIXEL_FORMAT_NAMES) / sizeof(PIXEL_FORMAT_NAMES[0])); i++) {
+        if (!strcmp(name, PIXEL_FORMAT_NAMES[i])) {
+            format = (PixelFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -18,5 +18,12 @@
 #define IDM_STILL_DURATION_40 4005
 #define IDM_STILL_DURATION_50 4006
 #define IDM_STILL_DURATION_100 4007
+#define IDM_SAMPLED_AVERAGE 4008
+#define IDM_RECORD_FRAMES 4009
+#define IDM_CONTINUOUS_LOG 4010
+#define IDM_LIVE_TELEMETRY 4011
+#define IDM_SAVE_TELEMETRY 4012
+#define IDM_TILE_SIGNATURES 4013
+#define IDM_PUBLISH_RESULTS 4014
 
 #endif
@@ -0,0 +1,291 @@
+#include "sharedring.h"
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <signal.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+static const char RING_MAGIC[4] = {'C', 'G', 'S', 'R'};
+constexpr uint32_t RING_VERSION = 1;
+
+static_assert(sizeof(SharedRingHeader) == 64, "SharedRingHeader must fill a cache line");
+static_assert(sizeof(SharedRingSlot) == 64, "SharedRingSlot must fill a cache line");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared sequences must be lock free");
+
+static size_t getRingSize(uint32_t capacity) {
+    return sizeof(SharedRingHeader) + (size_t)capacity * sizeof(SharedRingSlot);
+}
+
+#ifdef _WIN32
+static std::wstring getMappingName(const std::string& name) {
+    const int size = MultiByteToWideChar(CP_UTF8, 0, name.c_str(), (int)name.size(), nullptr, 0);
+    std::wstring wideName(size, 0);
+    MultiByteToWideChar(CP_UTF8, 0, name.c_str(), (int)name.size(), &wideName[0], size);
+    return L"Local\\" + wideName;
+}
+#else
+static std::string getMappingName(const std::string& name) {
+    return "/" + name;
+}
+
+// True when the shared memory of that name is a ring whose writer process is gone. Anything else, a live writer, a ring
+// still being set up or memory that is not a ring, is left alone.
+static bool isStaleRing(const std::string& mappingName) {
+    const int descriptor = shm_open(mappingName.c_str(), O_RDONLY, 0);
+    if (descriptor < 0) {
+        // Removed meanwhile, so there is nothing left to replace
+        return errno == ENOENT;
+    }
+    struct stat status;
+    void* data = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0 && (size_t)status.st_size >= sizeof(SharedRingHeader)) {
+        data = mmap(nullptr, sizeof(SharedRingHeader), PROT_READ, MAP_SHARED, descriptor, 0);
+    }
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    const SharedRingHeader* header = (const SharedRingHeader*)data;
+    const pid_t writer = (pid_t)header->iWriterProcess;
+    const bool stale = memcmp(header->aMagic, RING_MAGIC, sizeof(RING_MAGIC)) == 0 && writer > 0 && kill(writer, 0) != 0 &&
+                       errno == ESRCH;
+    munmap(data, sizeof(SharedRingHeader));
+    return stale;
+}
+#endif
+
+//--------------------------------------------------------------------------------------------
+// SharedRingWriter implementation
+//--------------------------------------------------------------------------------------------
+SharedRingWriter::SharedRingWriter(const std::string& name)
+    : sName(name)
+    , pHeader(nullptr)
+    , pSlots(nullptr)
+    , iSize(0)
+    , bWithStats(false)
+#ifdef _WIN32
+    , hMapping(NULL)
+#endif
+{
+}
+
+std::shared_ptr<SharedRingWriter> SharedRingWriter::Create(const std::string& name, bool withStats, uint32_t capacity) {
+    if (name.empty() || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return nullptr;
+    }
+    std::shared_ptr<SharedRingWriter> writer(new SharedRingWriter(name));
+    writer->iSize = getRingSize(capacity);
+    writer->bWithStats = withStats;
+#ifdef _WIN32
+    // The mapping lives as long as a process holds it, so an existing one belongs to a running writer
+    writer->hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)writer->iSize >> 32),
+                                          (DWORD)writer->iSize, getMappingName(name).c_str());
+    if (!writer->hMapping || GetLastError() == ERROR_ALREADY_EXISTS) {
+        return nullptr;
+    }
+    void* data = MapViewOfFile(writer->hMapping, FILE_MAP_WRITE, 0, 0, writer->iSize);
+    if (!data) {
+        return nullptr;
+    }
+#else
+    // Shared memory outlives its processes, so a ring left by a writer that crashed is replaced, but like on Windows a ring
+    // whose writer still runs is not: its readers would keep polling a ring nobody writes to anymore
+    const std::string mappingName = getMappingName(name);
+    int descriptor = shm_open(mappingName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (descriptor < 0 && errno == EEXIST && isStaleRing(mappingName)) {
+        shm_unlink(mappingName.c_str());
+        descriptor = shm_open(mappingName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    void* data = MAP_FAILED;
+    if (ftruncate(descriptor, (off_t)writer->iSize) == 0) {
+        data = mmap(nullptr, writer->iSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    }
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        shm_unlink(mappingName.c_str());
+        return nullptr;
+    }
+#endif
+    // The memory starts zeroed; the magic is written last, so readers never see a ring being set up
+    writer->pHeader = (SharedRingHeader*)data;
+    writer->pSlots = (SharedRingSlot*)((uint8_t*)data + sizeof(SharedRingHeader));
+    writer->pHeader->iVersion = RING_VERSION;
+    writer->pHeader->iFlags = withStats ? RING_FLAG_STATS : 0;
+    writer->pHeader->iCapacity = capacity;
+    writer->pHeader->iSlotSize = sizeof(SharedRingSlot);
+#ifdef _WIN32
+    writer->pHeader->iWriterProcess = GetCurrentProcessId();
+#else
+    writer->pHeader->iWriterProcess = (uint32_t)getpid();
+#endif
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(writer->pHeader->aMagic, RING_MAGIC, sizeof(RING_MAGIC));
+    return writer;
+}
+
+SharedRingWriter::~SharedRingWriter() {
+#ifdef _WIN32
+    if (pHeader) {
+        UnmapViewOfFile(pHeader);
+    }
+    if (hMapping) {
+        CloseHandle(hMapping);
+    }
+#else
+    if (pHeader) {
+        munmap(pHeader, iSize);
+        shm_unlink(getMappingName(sName).c_str());
+    }
+#endif
+}
+
+void SharedRingWriter::Publish(const CaptureItem& item) {
+    LogEntry entry = {};
+    entry.iTimestamp = item.iTimestamp;
+    entry.cAvgColor = item.cAvgColor;
+    entry.iRegion = item.iRegion;
+    if (bWithStats) {
+        entry.lsStats = getLogStats(item.fsStats);
+    }
+    // Each writer claims its own entry; the odd sequence is visible before any byte of the slot changes
+    const uint64_t index = pHeader->iClaimed.fetch_add(1, std::memory_order_relaxed);
+    SharedRingSlot& slot = pSlots[index & (pHeader->iCapacity - 1)];
+    const uint64_t writing = 2 * index + 1;
+    // Writers sharing a slot are a whole lap apart, which only happens when one stalls for a lap. The sequence of a slot
+    // never goes down: a writer finding a later entry's sequence drops its own, which readers then count as lost, and one
+    // finding an earlier entry still being copied waits for it, so entries are never torn.
+    uint64_t sequence = slot.iSequence.load(std::memory_order_relaxed);
+    while (true) {
+        if (sequence > writing) {
+            return;
+        }
+        if (sequence & 1) {
+            std::this_thread::yield();
+            sequence = slot.iSequence.load(std::memory_order_relaxed);
+        } else if (slot.iSequence.compare_exchange_weak(sequence, writing, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.leEntry, &entry, sizeof(LogEntry));
+    slot.iSequence.store(writing + 1, std::memory_order_release);
+}
+
+//--------------------------------------------------------------------------------------------
+// SharedRingReader implementation
+//--------------------------------------------------------------------------------------------
+SharedRingReader::SharedRingReader()
+    : pHeader(nullptr)
+    , pSlots(nullptr)
+    , iSize(0)
+    , iNext(0)
+    , iLostCount(0)
+#ifdef _WIN32
+    , hMapping(NULL)
+#endif
+{
+}
+
+std::shared_ptr<SharedRingReader> SharedRingReader::Open(const std::string& name, bool fromOldest) {
+    std::shared_ptr<SharedRingReader> reader(new SharedRingReader());
+#ifdef _WIN32
+    reader->hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, getMappingName(name).c_str());
+    if (!reader->hMapping) {
+        return nullptr;
+    }
+    const void* data = MapViewOfFile(reader->hMapping, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION region;
+    if (!data) {
+        return nullptr;
+    }
+    reader->pHeader = (const SharedRingHeader*)data;
+    if (!VirtualQuery(data, &region, sizeof(region))) {
+        return nullptr;
+    }
+    reader->iSize = region.RegionSize;
+#else
+    const int descriptor = shm_open(getMappingName(name).c_str(), O_RDONLY, 0);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    void* data = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0 && (size_t)status.st_size >= sizeof(SharedRingHeader)) {
+        data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    }
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    reader->pHeader = (const SharedRingHeader*)data;
+    reader->iSize = (size_t)status.st_size;
+#endif
+    const SharedRingHeader& header = *reader->pHeader;
+    if (memcmp(header.aMagic, RING_MAGIC, sizeof(RING_MAGIC)) != 0) {
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header.iVersion != RING_VERSION || header.iSlotSize != sizeof(SharedRingSlot) || header.iCapacity == 0 ||
+        (header.iCapacity & (header.iCapacity - 1)) != 0 || getRingSize(header.iCapacity) > reader->iSize) {
+        return nullptr;
+    }
+    reader->pSlots = (const SharedRingSlot*)((const uint8_t*)data + sizeof(SharedRingHeader));
+    const uint64_t claimed = header.iClaimed.load(std::memory_order_acquire);
+    reader->iNext = fromOldest && claimed > header.iCapacity ? claimed - header.iCapacity : fromOldest ? 0 : claimed;
+    return reader;
+}
+
+SharedRingReader::~SharedRingReader() {
+#ifdef _WIN32
+    if (pHeader) {
+        UnmapViewOfFile(pHeader);
+    }
+    if (hMapping) {
+        CloseHandle(hMapping);
+    }
+#else
+    if (pHeader) {
+        munmap((void*)pHeader, iSize);
+    }
+#endif
+}
+
+bool SharedRingReader::Read(LogEntry& entry) {
+    const uint64_t capacity = pHeader->iCapacity;
+    while (true) {
+        const SharedRingSlot& slot = pSlots[iNext & (capacity - 1)];
+        const uint64_t expected = 2 * iNext + 2;
+        const uint64_t before = slot.iSequence.load(std::memory_order_acquire);
+        if (before < expected && pHeader->iClaimed.load(std::memory_order_acquire) < iNext + capacity) {
+            // Not claimed yet, or still being written
+            return false;
+        }
+        if (before == expected) {
+            LogEntry copy;
+            memcpy(&copy, &slot.leEntry, sizeof(LogEntry));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.iSequence.load(std::memory_order_relaxed) == expected) {
+                entry = copy;
+                iNext++;
+                return true;
+            }
+        }
+        // Lapped by the writers, or the writer of this entry dropped it or stalled for a whole lap: skips to the oldest
+        // entry still in the ring
+        const uint64_t claimed = pHeader->iClaimed.load(std::memory_order_acquire);
+        const uint64_t oldest = claimed > capacity ? claimed - capacity : 0;
+        const uint64_t next = oldest > iNext ? oldest : iNext + 1;
+        iLostCount += next - iNext;
+        iNext = next;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef __CAPGRAPH_SHAREDRING_H__
+#define __CAPGRAPH_SHAREDRING_H__
+#include "binarylog.h"
+#include "captureitem.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Ring of capture results in named shared memory (POSIX shm_open, or a paging file mapping in the Local\ namespace on
+// Windows), which any number of local processes read without locks and without the writers ever waiting for them.
+//
+//   SharedRingHeader
+//   iCapacity SharedRingSlot, the n-th entry published going to slot n % iCapacity
+//
+// Each slot is a seqlock: its sequence is 2n + 1 while entry n is being written and 2n + 2 once it is complete. A reader
+// expecting entry n copies the slot between two reads of the sequence and keeps the copy when both are 2n + 2; a larger
+// sequence means writers lapped it and entry n is lost.
+
+constexpr uint32_t RING_FLAG_STATS = 1;
+constexpr uint32_t DEFAULT_RING_CAPACITY = 4096;
+constexpr const char* DEFAULT_RING_NAME = "capgraph";
+
+struct SharedRingHeader {
+    char aMagic[4];
+    uint32_t iVersion;
+    uint32_t iFlags;
+    // Slot count, a power of two
+    uint32_t iCapacity;
+    uint32_t iSlotSize;
+    // Process id of the writer, so a ring left by a writer that died can be told from one still in use
+    uint32_t iWriterProcess;
+    // Entries claimed by writers so far, the next one going to slot iClaimed % iCapacity
+    std::atomic<uint64_t> iClaimed;
+    uint64_t aReserved[4];
+};
+
+struct SharedRingSlot {
+    std::atomic<uint64_t> iSequence;
+    LogEntry leEntry;
+};
+
+// Publishes capture items to a new ring. Publish may be called from several threads.
+class SharedRingWriter {
+public:
+    // Returns null when the shared memory can't be created, or when a running writer already publishes under that name
+    static std::shared_ptr<SharedRingWriter> Create(const std::string& name, bool withStats,
+                                                    uint32_t capacity = DEFAULT_RING_CAPACITY);
+    // Removes the name; readers that opened the ring keep reading what was published
+    ~SharedRingWriter();
+
+    const std::string& GetName() const {
+        return sName;
+    }
+    void Publish(const CaptureItem& item);
+
+private:
+    SharedRingWriter(const std::string& name);
+    SharedRingWriter(const SharedRingWriter&) = delete;
+    SharedRingWriter& operator=(const SharedRingWriter&) = delete;
+
+    std::string sName;
+    SharedRingHeader* pHeader;
+    SharedRingSlot* pSlots;
+    size_t iSize;
+    bool bWithStats;
+#ifdef _WIN32
+    void* hMapping;
+#endif
+};
+
+// Reads the entries of a ring in order. Each reader keeps its own position, so readers don't disturb each other.
+class SharedRingReader {
+public:
+    // Returns null when there is no ring of that name or it is not a capture ring. Reading starts with the next entry
+    // published, or with the oldest one still in the ring when fromOldest is set.
+    static std::shared_ptr<SharedRingReader> Open(const std::string& name, bool fromOldest = false);
+    ~SharedRingReader();
+
+    bool HasStats() const {
+        return (pHeader->iFlags & RING_FLAG_STATS) != 0;
+    }
+    uint32_t GetCapacity() const {
+        return pHeader->iCapacity;
+    }
+    // Entries overwritten before this reader got to them
+    uint64_t GetLostCount() const {
+        return iLostCount;
+    }
+
+    // Copies the next entry and returns true, or returns false when it was not published yet
+    bool Read(LogEntry& entry);
+
+private:
+    SharedRingReader();
+    SharedRingReader(const SharedRingReader&) = delete;
+    SharedRingReader& operator=(const SharedRingReader&) = delete;
+
+    const SharedRingHeader* pHeader;
+    const SharedRingSlot* pSlots;
+    size_t iSize;
+    uint64_t iNext;
+    uint64_t iLostCount;
+#ifdef _WIN32
+    void* hMapping;
+#endif
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef __CAPGRAPH_SPSCQUEUE_H__
+#define __CAPGRAPH_SPSCQUEUE_H__
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Lock-free bounded queue for exactly one producer thread and one consumer thread.
+// Each side caches the other side's index, so the shared cache lines are only touched when the cached view runs out.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : iHead(0)
+        , iCachedTail(0)
+        , iTail(0)
+        , iCachedHead(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        iMask = size - 1;
+        pSlots.reset(new T[size]);
+    }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    size_t GetCapacity() const {
+        return iMask + 1;
+    }
+
+    // Producer side: returns false when the queue is full
+    bool TryPush(T item) {
+        const size_t tail = iTail.load(std::memory_order_relaxed);
+        if (tail - iCachedHead > iMask) {
+            iCachedHead = iHead.load(std::memory_order_acquire);
+            if (tail - iCachedHead > iMask) {
+                return false;
+            }
+        }
+        pSlots[tail & iMask] = std::move(item);
+        iTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: returns false when the queue is empty
+    bool TryPop(T& item) {
+        const size_t head = iHead.load(std::memory_order_relaxed);
+        if (head == iCachedTail) {
+            iCachedTail = iTail.load(std::memory_order_acquire);
+            if (head == iCachedTail) {
+                return false;
+            }
+        }
+        item = std::move(pSlots[head & iMask]);
+        iHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: hands up to maxItems queued items to consumer, releasing their slots in a single store.
+    // Returns the number of items consumed.
+    template <typename Consumer>
+    size_t Drain(Consumer&& consumer, size_t maxItems) {
+        const size_t head = iHead.load(std::memory_order_relaxed);
+        iCachedTail = iTail.load(std::memory_order_acquire);
+        size_t count = iCachedTail - head;
+        if (count > maxItems) {
+            count = maxItems;
+        }
+        for (size_t i = 0; i < count; i++) {
+            consumer(pSlots[(head + i) & iMask]);
+        }
+        if (count) {
+            iHead.store(head + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // Approximate when called while the other side is active
+    bool IsEmpty() const {
+        return iHead.load(std::memory_order_acquire) == iTail.load(std::memory_order_acquire);
+    }
+
+private:
+    // Consumer owned
+    alignas(64) std::atomic<size_t> iHead;
+    size_t iCachedTail;
+    // Producer owned
+    alignas(64) std::atomic<size_t> iTail;
+    size_t iCachedHead;
+    // Shared, read only after construction
+    alignas(64) size_t iMask;
+    std::unique_ptr<T[]> pSlots;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "stillnessengine.h"
+#include "capturetelemetry.h"
+#include <utility>
+
+CaptureItem getStillImageItem(const void* frame, const void* previous, size_t pixelCount, int64_t timestamp,
+                              uint32_t region, const EngineSettings& settings) {
+    CaptureItem item = CaptureItem();
+    item.fsStats = reduceFrameSampled(frame, previous, pixelCount, settings.iSampleBudget, (uint64_t)timestamp, settings.pfFormat);
+    item.iTimestamp = timestamp;
+    item.cAvgColor = item.fsStats.AverageColor();
+    item.iRegion = region;
+    return item;
+}
+
+//--------------------------------------------------------------------------------------------
+// StillnessEngine implementation
+//--------------------------------------------------------------------------------------------
+StillnessEngine::StillnessEngine(uint32_t region)
+    : iRegion(region)
+    , dSignatureDiff(0)
+    , ceEvent() {
+}
+
+void StillnessEngine::Start() {
+    stTracker.Start();
+}
+
+void StillnessEngine::Stop() {
+    stTracker.Stop();
+}
+
+bool StillnessEngine::CompareFrame(const void* frame, const void* previous, int width, int height,
+                                   const EngineSettings& settings) {
+    const size_t pixelCount = (size_t)width * height;
+    if (tgTiles.GetWidth() != width || tgTiles.GetHeight() != height || tgTiles.GetFormat() != settings.pfFormat) {
+        tgTiles = TileGrid(width, height, TileGrid::DEFAULT_TILE_SIZE, settings.pfFormat);
+        vTileHashes.clear();
+        vTileSignatures.clear();
+        vStaleSignatures.clear();
+        previous = nullptr;
+    }
+    // Hashes the frame per tile; only tiles whose hashes changed need a pixel comparison
+    std::swap(vTileHashes, vPreviousTileHashes);
+    tgTiles.HashTiles(frame, vTileHashes);
+    dSignatureDiff = 0;
+    if (settings.rmReference == ReferenceMode::TileSignatures) {
+        // The lower bound of the MSE given by the signatures stands for the MSE. Signatures left stale by the
+        // coarse-to-fine comparison can't serve as reference.
+        if (!vStaleSignatures.empty()) {
+            vTileSignatures.clear();
+            vStaleSignatures.clear();
+        }
+        const bool hasReference = !vTileSignatures.empty();
+        const size_t dirtyTiles = tgTiles.DiffTiles(vTileHashes, vPreviousTileHashes, vDirtyTiles);
+        if (dirtyTiles > 0 || !hasReference) {
+            dSignatureDiff = tgTiles.UpdateSignatures(frame, vDirtyTiles, vTileSignatures) / (3.0 * pixelCount);
+        }
+        return hasReference && dSignatureDiff > settings.dSignatureThreshold;
+    }
+    size_t dirtyTiles = previous ? tgTiles.DiffTiles(vTileHashes, vPreviousTileHashes, vDirtyTiles) : 0;
+    bool imageChanged = false;
+    if (settings.bCoarseToFine) {
+        // The signatures must describe the previous frame, so they are all refreshed after a frame without reference
+        if (!previous) {
+            vTileSignatures.clear();
+        }
+        const double maxBound = settings.dChangeThreshold * 3.0 * pixelCount;
+        const double bound = tgTiles.CompareSignatures(frame, vDirtyTiles, vTileSignatures, vStaleSignatures, maxBound);
+        imageChanged = previous && bound > maxBound;
+    } else {
+        // Signatures would be stale when switching back
+        vTileSignatures.clear();
+    }
+    // Compare at full resolution if frames changed and the coarse level was inconclusive, stopping as soon as the
+    // difference is known to be above the threshold
+    return imageChanged || (dirtyTiles > 0 && tgTiles.TilesDiffer(frame, previous, vDirtyTiles, settings.dChangeThreshold));
+}
+
+bool StillnessEngine::ProcessFrame(const void* frame, const void* previous, int width, int height, int64_t timestamp,
+                                   const EngineSettings& settings) {
+    ceEvent.seType = StillnessEvent::None;
+    // Stage timing, only when someone listens
+    CaptureTelemetry* telemetry = settings.pTelemetry;
+    auto stageStart = telemetry ? CaptureTelemetry::Clock::now() : CaptureTelemetry::Clock::time_point();
+    auto endStage = [telemetry, &stageStart](CaptureStage stage) {
+        if (telemetry) {
+            const auto now = CaptureTelemetry::Clock::now();
+            telemetry->Record(stage, now - stageStart);
+            stageStart = now;
+        }
+    };
+    const size_t pixelCount = (size_t)width * height;
+    // A new frame size or format restarts the comparisons, and the previous frame is then of no use
+    if (tgTiles.GetWidth() != width || tgTiles.GetHeight() != height || tgTiles.GetFormat() != settings.pfFormat ||
+        settings.rmReference == ReferenceMode::TileSignatures) {
+        previous = nullptr;
+    }
+    const bool imageChanged = CompareFrame(frame, previous, width, height, settings);
+    endStage(CaptureStage::Compare);
+    const auto event = stTracker.Update(imageChanged, timestamp, settings.iStillDuration);
+    endStage(CaptureStage::Transition);
+    if (event == StillnessEvent::None) {
+        return false;
+    }
+    ceEvent = CaptureEvent();
+    ceEvent.seType = event;
+    ceEvent.ciItem.iRegion = iRegion;
+    if (event == StillnessEvent::StillImage) {
+        ceEvent.ciItem = getStillImageItem(frame, previous, pixelCount, timestamp, iRegion, settings);
+        endStage(CaptureStage::Average);
+    } else if (settings.rmReference == ReferenceMode::TileSignatures) {
+        ceEvent.dDiff = dSignatureDiff;
+    } else {
+        // The full difference is only needed for the status bar
+        ceEvent.dDiff = (double)tgTiles.SumSquaredDifferences(frame, previous, vDirtyTiles) / (3 * pixelCount);
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef __CAPGRAPH_STILLNESSENGINE_H__
+#define __CAPGRAPH_STILLNESSENGINE_H__
+#include "captureitem.h"
+#include "stillnesstracker.h"
+#include "tilegrid.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CaptureTelemetry;
+
+// FILETIME ticks per millisecond
+constexpr int64_t FILE_TIME_TO_MILLISECONDS = 10000ll;
+
+// What each frame is compared against
+enum class ReferenceMode {
+    // The previous frame, pixel by pixel
+    Frame,
+    // Signatures of the tiles of the previous frame (see TileGrid::UpdateSignatures). The previous frame is not needed,
+    // but changes that keep the sums of every 4x4 cell, like pixels moving within a cell, go unnoticed.
+    TileSignatures,
+};
+
+struct EngineSettings {
+    // Mean square error above which a frame is considered different from the previous one
+    double dChangeThreshold = 0.01;
+    // Time an image must stay unchanged to be recorded, in FILETIME ticks
+    int64_t iStillDuration = 3000 * FILE_TIME_TO_MILLISECONDS;
+    // Pixels sampled to average a still image, zero to read every pixel (see reduceFrameSampled)
+    size_t iSampleBudget = 0;
+    ReferenceMode rmReference = ReferenceMode::Frame;
+    // Layout of the frames, which are analyzed as they come (see PixelFormat)
+    PixelFormat pfFormat = PixelFormat::BGRA32;
+    // With ReferenceMode::Frame, compares the tile signatures of the dirty tiles first (see TileGrid::CompareSignatures)
+    // and only reads both frames at full resolution when their bound stays under the change threshold. Since the bound
+    // never exceeds the MSE, the outcome is the same, but frames that clearly changed are told from a single frame.
+    bool bCoarseToFine = true;
+    // Threshold of the MSE lower bound given by the tile signatures. Since the bound never exceeds the MSE, the default
+    // never finds a change the frame reference would miss; lower values also catch changes spread thinly over the cells.
+    double dSignatureThreshold = 0.01;
+    // Receives the latencies of the compare, average and transition stages when set
+    CaptureTelemetry* pTelemetry = nullptr;
+};
+
+// Item recorded for a still image: its average color and statistics, with the squared differences against previous
+// (null with ReferenceMode::TileSignatures, as the engine does not keep the previous frame then)
+CaptureItem getStillImageItem(const void* frame, const void* previous, size_t pixelCount, int64_t timestamp,
+                              uint32_t region, const EngineSettings& settings);
+
+// Still image detection for one region, independent of where the frames come from: compares each frame with the
+// previous one, runs the state machine and averages the still images. The live capture and the offline replay share it,
+// so both produce the same items from the same frames.
+class StillnessEngine {
+public:
+    explicit StillnessEngine(uint32_t region = 0);
+
+    // Starts as if the current image was already recorded (see StillnessTracker)
+    void Start();
+    void Stop();
+
+    const StillnessTracker& GetTracker() const {
+        return stTracker;
+    }
+
+    // Processes a frame of width x height pixels in settings.pfFormat taken at timestamp (FILETIME ticks). previous is the frame
+    // processed before it, or null for the first one; it's only read when comparing with ReferenceMode::Frame.
+    // Returns true when an event was produced, which is then available from GetEvent until the next call.
+    bool ProcessFrame(const void* frame, const void* previous, int width, int height, int64_t timestamp,
+                      const EngineSettings& settings);
+    // Comparison step of ProcessFrame, without the state machine: tells whether frame changed from previous. The answer
+    // only depends on the two frames, so frames can be compared out of order by engines primed with the frame before.
+    bool CompareFrame(const void* frame, const void* previous, int width, int height, const EngineSettings& settings);
+    const CaptureEvent& GetEvent() const {
+        return ceEvent;
+    }
+
+private:
+    uint32_t iRegion;
+    StillnessTracker stTracker;
+    TileGrid tgTiles;
+    std::vector<uint64_t> vTileHashes;
+    std::vector<uint64_t> vPreviousTileHashes;
+    std::vector<uint8_t> vDirtyTiles;
+    std::vector<uint16_t> vTileSignatures;
+    std::vector<uint8_t> vStaleSignatures;
+    // Difference measured by the signatures on the last comparison
+    double dSignatureDiff;
+    CaptureEvent ceEvent;
+};
+
+#endif
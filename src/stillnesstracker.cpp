@@ -0,0 +1,41 @@
+#include "stillnesstracker.h"
+
+StillnessTracker::StillnessTracker()
+    : csStatus(CaptureStatus::NotStarted)
+    , iLastChange(0) {
+}
+
+void StillnessTracker::Start() {
+    csStatus = CaptureStatus::StillImage;
+    iLastChange = 0;
+}
+
+void StillnessTracker::Stop() {
+    csStatus = CaptureStatus::NotStarted;
+}
+
+StillnessEvent StillnessTracker::Update(bool imageChanged, int64_t now, int64_t stillDuration) {
+    if (csStatus == CaptureStatus::WaitingStillImage) {
+        if (imageChanged) {
+            iLastChange = now;
+        } else if (now - iLastChange > stillDuration) {
+            csStatus = CaptureStatus::StillImage;
+            return StillnessEvent::StillImage;
+        }
+    } else if (csStatus == CaptureStatus::StillImage) {
+        if (imageChanged) {
+            iLastChange = now;
+            csStatus = CaptureStatus::WaitingStillImage;
+            return StillnessEvent::ImageChanged;
+        }
+    }
+    return StillnessEvent::None;
+}
+
+int64_t StillnessTracker::GetStillTimeRemaining(int64_t now, int64_t stillDuration) const {
+    if (csStatus != CaptureStatus::WaitingStillImage) {
+        return 0;
+    }
+    const int64_t remaining = stillDuration - (now - iLastChange);
+    return remaining > 0 ? remaining : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef __CAPGRAPH_STILLNESSTRACKER_H__
+#define __CAPGRAPH_STILLNESSTRACKER_H__
+#include "capturestatus.h"
+#include <cstdint>
+
+enum class StillnessEvent {
+    None,
+    // The image stayed unchanged for the still duration and should be recorded
+    StillImage,
+    // A recorded still image changed, waiting for the next one
+    ImageChanged,
+};
+
+// Still image state machine of a single capture region. Times are counted in 100 ns ticks, like FILETIME.
+class StillnessTracker {
+public:
+    StillnessTracker();
+
+    // Starts as if the current image was already recorded, so only images shown after the start are recorded
+    void Start();
+    void Stop();
+
+    CaptureStatus GetStatus() const {
+        return csStatus;
+    }
+
+    // Advances the state machine with the result of a frame comparison
+    StillnessEvent Update(bool imageChanged, int64_t now, int64_t stillDuration);
+    // Time left before the current wait qualifies as a still image, zero when not waiting
+    int64_t GetStillTimeRemaining(int64_t now, int64_t stillDuration) const;
+
+private:
+    CaptureStatus csStatus;
+    int64_t iLastChange;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "taskpool.h"
+
+// Pool and deque index of the current thread, so tasks submitted by a task stay on its thread
+static thread_local const TaskPool* currentPool = nullptr;
+static thread_local size_t currentQueue = 0;
+
+size_t TaskPool::DefaultThreadCount() {
+    const size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+TaskPool::TaskPool(size_t threadCount)
+    : bShutdown(false)
+    , iQueuedTasks(0)
+    , iPendingTasks(0)
+    , iNextQueue(0)
+    , iStealCount(0) {
+    threadCount = threadCount > 0 ? threadCount : 1;
+    for (size_t i = 0; i < threadCount; i++) {
+        vQueues.emplace_back(new TaskQueue());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        vThreads.emplace_back(&TaskPool::WorkerLoop, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mState);
+        bShutdown = true;
+    }
+    cvTaskReady.notify_all();
+    for (auto& thread : vThreads) {
+        thread.join();
+    }
+}
+
+void TaskPool::Submit(Task task) {
+    const size_t index = currentPool == this ? currentQueue : iNextQueue.fetch_add(1, std::memory_order_relaxed) % vQueues.size();
+    iPendingTasks.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(vQueues[index]->mTasks);
+        vQueues[index]->dqTasks.push_back(std::move(task));
+        iQueuedTasks.fetch_add(1, std::memory_order_release);
+    }
+    // Counted before taking the state lock, so a thread going to sleep either sees the task or gets the notification
+    {
+        std::lock_guard<std::mutex> lock(mState);
+    }
+    cvTaskReady.notify_one();
+}
+
+void TaskPool::Wait() {
+    std::unique_lock<std::mutex> lock(mState);
+    cvAllDone.wait(lock, [this] { return iPendingTasks.load(std::memory_order_acquire) == 0; });
+}
+
+bool TaskPool::PopTask(size_t index, Task& task) {
+    {
+        TaskQueue& own = *vQueues[index];
+        std::lock_guard<std::mutex> lock(own.mTasks);
+        if (!own.dqTasks.empty()) {
+            task = std::move(own.dqTasks.back());
+            own.dqTasks.pop_back();
+            iQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    // Steals from the next deques in turn, so thieves don't all start with the same victim
+    for (size_t i = 1; i < vQueues.size(); i++) {
+        TaskQueue& victim = *vQueues[(index + i) % vQueues.size()];
+        std::lock_guard<std::mutex> lock(victim.mTasks);
+        if (!victim.dqTasks.empty()) {
+            task = std::move(victim.dqTasks.front());
+            victim.dqTasks.pop_front();
+            iQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            iStealCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::WorkerLoop(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    Task task;
+    while (true) {
+        if (PopTask(index, task)) {
+            task();
+            task = nullptr;
+            if (iPendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mState);
+                cvAllDone.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mState);
+        cvTaskReady.wait(lock, [this] { return bShutdown || iQueuedTasks.load(std::memory_order_acquire) > 0; });
+        if (bShutdown) {
+            return;
+        }
+    }
+}
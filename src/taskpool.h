@@ -0,0 +1,65 @@
+#ifndef __CAPGRAPH_TASKPOOL_H__
+#define __CAPGRAPH_TASKPOOL_H__
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool for batches of tasks that may split themselves in more tasks. Each thread has its own deque:
+// tasks submitted from a pool thread go to the back of its deque and are run newest first, so work stays in the caches
+// of the thread that produced it, while idle threads steal the oldest tasks, usually the largest, from the front of the
+// other deques. Unlike ThreadPool, the calling thread doesn't take part: it only waits.
+class TaskPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit TaskPool(size_t threadCount = DefaultThreadCount());
+    ~TaskPool();
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // One thread per hardware thread
+    static size_t DefaultThreadCount();
+
+    size_t GetThreadCount() const {
+        return vThreads.size();
+    }
+    // Tasks run by another thread than the one they were submitted to
+    uint64_t GetStealCount() const {
+        return iStealCount.load(std::memory_order_relaxed);
+    }
+
+    // Queues a task on the deque of the calling pool thread, or spreads them over the deques from other threads
+    void Submit(Task task);
+    // Returns once every task submitted, including those submitted by tasks meanwhile, has finished
+    void Wait();
+
+private:
+    struct TaskQueue {
+        std::mutex mTasks;
+        std::deque<Task> dqTasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> vQueues;
+    std::vector<std::thread> vThreads;
+    std::mutex mState;
+    std::condition_variable cvTaskReady;
+    std::condition_variable cvAllDone;
+    bool bShutdown;
+    // Tasks waiting in the deques, and tasks submitted but not finished
+    std::atomic<size_t> iQueuedTasks;
+    std::atomic<size_t> iPendingTasks;
+    std::atomic<size_t> iNextQueue;
+    std::atomic<uint64_t> iStealCount;
+
+    void WorkerLoop(size_t index);
+    bool PopTask(size_t index, Task& task);
+};
+
+#endif
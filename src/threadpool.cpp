@@ -0,0 +1,87 @@
+#include "threadpool.h"
+#include <algorithm>
+
+// Per tick jobs are a handful of regions, so more threads would mostly sit idle
+constexpr size_t MAX_DEFAULT_WORKERS = 7;
+
+size_t ThreadPool::DefaultWorkerCount() {
+    const size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? (std::min)(hardwareThreads - 1, MAX_DEFAULT_WORKERS) : 0;
+}
+
+ThreadPool::ThreadPool(size_t workerCount)
+    : pJob(nullptr)
+    , iJobSize(0)
+    , iJobGeneration(0)
+    , iBusyWorkers(0)
+    , bShutdown(false)
+    , iNextIndex(0) {
+    for (size_t i = 0; i < workerCount; i++) {
+        vThreads.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mJob);
+        bShutdown = true;
+    }
+    cvJobReady.notify_all();
+    for (auto& thread : vThreads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const IndexHandler& onIndex) {
+    if (count == 0) {
+        return;
+    }
+    // Waking workers costs more than running a single index here
+    if (vThreads.empty() || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            onIndex(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mJob);
+        pJob = &onIndex;
+        iJobSize = count;
+        iNextIndex.store(0, std::memory_order_relaxed);
+        iBusyWorkers = vThreads.size();
+        iJobGeneration++;
+    }
+    cvJobReady.notify_all();
+    RunIndices(onIndex, count);
+    std::unique_lock<std::mutex> lock(mJob);
+    cvJobDone.wait(lock, [this] { return iBusyWorkers == 0; });
+    pJob = nullptr;
+}
+
+void ThreadPool::WorkerLoop() {
+    uint64_t lastGeneration = 0;
+    std::unique_lock<std::mutex> lock(mJob);
+    while (true) {
+        cvJobReady.wait(lock, [this, lastGeneration] { return bShutdown || iJobGeneration != lastGeneration; });
+        if (bShutdown) {
+            return;
+        }
+        lastGeneration = iJobGeneration;
+        const IndexHandler* job = pJob;
+        const size_t count = iJobSize;
+        lock.unlock();
+        RunIndices(*job, count);
+        lock.lock();
+        if (--iBusyWorkers == 0) {
+            cvJobDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::RunIndices(const IndexHandler& onIndex, size_t count) {
+    // Indices are handed out one at a time, since regions can differ a lot in size
+    size_t index;
+    while ((index = iNextIndex.fetch_add(1, std::memory_order_relaxed)) < count) {
+        onIndex(index);
+    }
+}
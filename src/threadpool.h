@@ -0,0 +1,50 @@
+#ifndef __CAPGRAPH_THREADPOOL_H__
+#define __CAPGRAPH_THREADPOOL_H__
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed set of worker threads that split index ranges with the calling thread.
+// Meant for short per-tick jobs, so the workers are kept alive between jobs.
+class ThreadPool {
+public:
+    typedef std::function<void(size_t)> IndexHandler;
+
+    explicit ThreadPool(size_t workerCount = DefaultWorkerCount());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // One less than the hardware threads, since the calling thread takes part in the jobs
+    static size_t DefaultWorkerCount();
+
+    size_t GetWorkerCount() const {
+        return vThreads.size();
+    }
+
+    // Calls onIndex for every index in [0, count), on the workers and on the calling thread, and returns once all
+    // calls finished. Must be called from one thread at a time.
+    void ParallelFor(size_t count, const IndexHandler& onIndex);
+
+private:
+    std::vector<std::thread> vThreads;
+    std::mutex mJob;
+    std::condition_variable cvJobReady;
+    std::condition_variable cvJobDone;
+    const IndexHandler* pJob;
+    size_t iJobSize;
+    uint64_t iJobGeneration;
+    size_t iBusyWorkers;
+    bool bShutdown;
+    std::atomic<size_t> iNextIndex;
+
+    void WorkerLoop();
+    void RunIndices(const IndexHandler& onIndex, size_t count);
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "tilegrid.h"
+#include "framekernels.h"
+#include <algorithm>
+#include <cstring>
+
+// Tile hashes follow the xxHash64 round structure: four independent lanes over 64-bit words, then an avalanche
+constexpr uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t HASH_PRIME3 = 0x165667B19E3779F9ull;
+constexpr uint64_t HASH_PRIME4 = 0x85EBCA77C2B2AE63ull;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t hashRound(uint64_t lane, uint64_t input) {
+    lane += input * HASH_PRIME2;
+    return rotateLeft(lane, 31) * HASH_PRIME1;
+}
+
+static inline void hashBlock(TileHashState& state, const uint8_t* block) {
+    uint64_t words[4];
+    memcpy(words, block, sizeof(words));
+    state.aLanes[0] = hashRound(state.aLanes[0], words[0]);
+    state.aLanes[1] = hashRound(state.aLanes[1], words[1]);
+    state.aLanes[2] = hashRound(state.aLanes[2], words[2]);
+    state.aLanes[3] = hashRound(state.aLanes[3], words[3]);
+}
+
+// Hashes size bytes in blocks of 32. Tiles keep their widths, so padding the last block with zeros is unambiguous.
+static void hashRow(TileHashState& state, const uint8_t* bytes, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        hashBlock(state, bytes + i);
+    }
+    if (i < size) {
+        uint8_t tail[32] = {};
+        memcpy(tail, bytes + i, size - i);
+        hashBlock(state, tail);
+    }
+}
+
+static uint64_t finishHash(const TileHashState& state) {
+    uint64_t hash = rotateLeft(state.aLanes[0], 1) + rotateLeft(state.aLanes[1], 7) + rotateLeft(state.aLanes[2], 12) +
+                    rotateLeft(state.aLanes[3], 18);
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+//--------------------------------------------------------------------------------------------
+// TileGrid implementation
+//--------------------------------------------------------------------------------------------
+TileGrid::TileGrid(int width, int height, int tileSize, PixelFormat format)
+    : iWidth((std::max)(width, 0))
+    , iHeight((std::max)(height, 0))
+    , iTileSize((std::max)(tileSize, 1))
+    , pfFormat(format)
+    , iPixelSize(getPixelSize(format)) {
+    iColumns = (iWidth + iTileSize - 1) / iTileSize;
+    iRows = (iHeight + iTileSize - 1) / iTileSize;
+    iCellsPerSide = (iTileSize + SIGNATURE_CELL_SIZE - 1) / SIGNATURE_CELL_SIZE;
+}
+
+void TileGrid::HashTiles(const void* pixels, std::vector<uint64_t>& hashes) const {
+    hashes.resize(GetTileCount());
+    std::vector<TileHashState>& states = vHashStates;
+    states.resize(iColumns);
+    for (int row = 0; row < iRows; row++) {
+        for (auto& state : states) {
+            state.aLanes[0] = HASH_PRIME1 + HASH_PRIME2;
+            state.aLanes[1] = HASH_PRIME2;
+            state.aLanes[2] = 0;
+            state.aLanes[3] = 0 - HASH_PRIME1;
+        }
+        // Walks the band of tiles line by line, so the frame is read sequentially
+        const int yEnd = (std::min)((row + 1) * iTileSize, iHeight);
+        for (int y = row * iTileSize; y < yEnd; y++) {
+            const uint8_t* line = (const uint8_t*)pixels + (size_t)y * iWidth * iPixelSize;
+            for (int column = 0; column < iColumns; column++) {
+                const int x = column * iTileSize;
+                hashRow(states[column], line + x * iPixelSize, (size_t)(std::min)(iTileSize, iWidth - x) * iPixelSize);
+            }
+        }
+        for (int column = 0; column < iColumns; column++) {
+            hashes[(size_t)row * iColumns + column] = finishHash(states[column]) ^ HASH_PRIME4;
+        }
+    }
+}
+
+size_t TileGrid::DiffTiles(const std::vector<uint64_t>& hashes, const std::vector<uint64_t>& previous,
+                           std::vector<uint8_t>& dirty) const {
+    const size_t tileCount = GetTileCount();
+    dirty.assign(tileCount, 1);
+    if (hashes.size() != tileCount || previous.size() != tileCount) {
+        return tileCount;
+    }
+    size_t dirtyCount = 0;
+    for (size_t i = 0; i < tileCount; i++) {
+        dirty[i] = hashes[i] != previous[i];
+        dirtyCount += dirty[i];
+    }
+    return dirtyCount;
+}
+
+uint64_t TileGrid::TileSumSquaredDifferences(const void* img1, const void* img2, size_t tile) const {
+    const int x = (int)(tile % iColumns) * iTileSize;
+    const int y = (int)(tile / iColumns) * iTileSize;
+    const int width = (std::min)(iTileSize, iWidth - x);
+    const int yEnd = (std::min)(y + iTileSize, iHeight);
+    const KernelIsa isa = getKernelIsa();
+    uint64_t sum = 0;
+    for (int line = y; line < yEnd; line++) {
+        const size_t offset = ((size_t)line * iWidth + x) * iPixelSize;
+        sum += sumSquaredDifferences((const uint8_t*)img1 + offset, (const uint8_t*)img2 + offset, width, pfFormat, isa);
+    }
+    return sum;
+}
+
+uint64_t TileGrid::SumSquaredDifferences(const void* img1, const void* img2, const std::vector<uint8_t>& dirty) const {
+    uint64_t sum = 0;
+    for (size_t tile = 0; tile < dirty.size(); tile++) {
+        if (dirty[tile]) {
+            sum += TileSumSquaredDifferences(img1, img2, tile);
+        }
+    }
+    return sum;
+}
+
+double TileGrid::TileSignatureBound(const void* pixels, size_t tile, uint16_t* signature, std::vector<uint32_t>& sums,
+                                    KernelIsa isa) const {
+    const int x = (int)(tile % iColumns) * iTileSize;
+    const int y = (int)(tile / iColumns) * iTileSize;
+    const int width = (std::min)(iTileSize, iWidth - x);
+    const int height = (std::min)(iTileSize, iHeight - y);
+    boxFilter((const uint8_t*)pixels + ((size_t)y * iWidth + x) * iPixelSize, iWidth, width, height, sums.data(), pfFormat, isa);
+    const int cellsPerRow = (width + SIGNATURE_CELL_SIZE - 1) / SIGNATURE_CELL_SIZE;
+    double bound = 0;
+    for (int cellY = 0; cellY * SIGNATURE_CELL_SIZE < height; cellY++) {
+        const int cellHeight = (std::min)(SIGNATURE_CELL_SIZE, height - cellY * SIGNATURE_CELL_SIZE);
+        for (int cellX = 0; cellX * SIGNATURE_CELL_SIZE < width; cellX++) {
+            const int cellWidth = (std::min)(SIGNATURE_CELL_SIZE, width - cellX * SIGNATURE_CELL_SIZE);
+            const size_t cell = ((size_t)cellY * iCellsPerSide + cellX) * 3;
+            const uint32_t* sum = &sums[((size_t)cellY * cellsPerRow + cellX) * 3];
+            int64_t squaredDiff = 0;
+            for (int c = 0; c < 3; c++) {
+                const int64_t diff = (int64_t)sum[c] - signature[cell + c];
+                squaredDiff += diff * diff;
+                signature[cell + c] = (uint16_t)sum[c];
+            }
+            bound += (double)squaredDiff / (cellWidth * cellHeight);
+        }
+    }
+    return bound;
+}
+
+double TileGrid::UpdateSignatures(const void* pixels, const std::vector<uint8_t>& dirty,
+                                  std::vector<uint16_t>& signatures) const {
+    const size_t stride = GetSignatureStride();
+    const bool hasReference = signatures.size() == GetTileCount() * stride && dirty.size() == GetTileCount();
+    if (!hasReference) {
+        signatures.assign(GetTileCount() * stride, 0);
+    }
+    std::vector<uint32_t>& sums = vSignatureSums;
+    sums.resize(stride);
+    const KernelIsa isa = getKernelIsa();
+    double bound = 0;
+    for (size_t tile = 0; tile < GetTileCount(); tile++) {
+        if (!hasReference || dirty[tile]) {
+            bound += TileSignatureBound(pixels, tile, &signatures[tile * stride], sums, isa);
+        }
+    }
+    return hasReference ? bound : 0.0;
+}
+
+double TileGrid::CompareSignatures(const void* pixels, const std::vector<uint8_t>& dirty, std::vector<uint16_t>& signatures,
+                                   std::vector<uint8_t>& stale, double maxBound) const {
+    const size_t tileCount = GetTileCount();
+    const size_t stride = GetSignatureStride();
+    if (signatures.size() != tileCount * stride || stale.size() != tileCount) {
+        signatures.assign(tileCount * stride, 0);
+        stale.assign(tileCount, 1);
+    }
+    const bool allDirty = dirty.size() != tileCount;
+    std::vector<uint32_t>& sums = vSignatureSums;
+    sums.resize(stride);
+    const KernelIsa isa = getKernelIsa();
+    double bound = 0;
+    for (size_t tile = 0; tile < tileCount; tile++) {
+        const bool tileDirty = allDirty || dirty[tile];
+        if (bound > maxBound) {
+            // Signatures of the tiles not reached keep describing an older frame
+            stale[tile] |= tileDirty;
+        } else if (stale[tile]) {
+            TileSignatureBound(pixels, tile, &signatures[tile * stride], sums, isa);
+            stale[tile] = 0;
+        } else if (tileDirty) {
+            bound += TileSignatureBound(pixels, tile, &signatures[tile * stride], sums, isa);
+        }
+    }
+    return bound;
+}
+
+bool TileGrid::TilesDiffer(const void* img1, const void* img2, const std::vector<uint8_t>& dirty, double threshold) const {
+    const size_t count = GetPixelCount();
+    if (count == 0) {
+        return false;
+    }
+    const double divisor = (double)(3 * count);
+    uint64_t sum = 0;
+    for (size_t tile = 0; tile < dirty.size(); tile++) {
+        if (dirty[tile]) {
+            sum += TileSumSquaredDifferences(img1, img2, tile);
+            if ((double)sum / divisor > threshold) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
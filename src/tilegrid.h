@@ -0,0 +1,96 @@
+#ifndef __CAPGRAPH_TILEGRID_H__
+#define __CAPGRAPH_TILEGRID_H__
+#include "framekernels.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lanes of the hash of a tile being hashed
+struct TileHashState {
+    uint64_t aLanes[4];
+};
+
+// Splits a frame (pixels of a given format stored row by row) in square tiles, so frames can be hashed and compared per tile.
+// A grid keeps scratch buffers across calls, so it is used by one thread at a time.
+class TileGrid {
+public:
+    static constexpr int DEFAULT_TILE_SIZE = 64;
+    // Side of the cells summarized by the tile signatures
+    static constexpr int SIGNATURE_CELL_SIZE = BOX_FILTER_SIZE;
+
+    TileGrid(int width = 0, int height = 0, int tileSize = DEFAULT_TILE_SIZE, PixelFormat format = PixelFormat::BGRA32);
+
+    int GetWidth() const {
+        return iWidth;
+    }
+    int GetHeight() const {
+        return iHeight;
+    }
+    PixelFormat GetFormat() const {
+        return pfFormat;
+    }
+    int GetTileSize() const {
+        return iTileSize;
+    }
+    int GetColumns() const {
+        return iColumns;
+    }
+    int GetRows() const {
+        return iRows;
+    }
+    size_t GetTileCount() const {
+        return (size_t)iColumns * iRows;
+    }
+    size_t GetPixelCount() const {
+        return (size_t)iWidth * iHeight;
+    }
+    // Values stored per tile in a signature set
+    size_t GetSignatureStride() const {
+        return (size_t)iCellsPerSide * iCellsPerSide * 3;
+    }
+
+    // Computes a 64-bit content hash for every tile, scanning the frame in memory order
+    void HashTiles(const void* pixels, std::vector<uint64_t>& hashes) const;
+    // Marks the tiles whose hashes differ between two hash sets. Returns the number of dirty tiles.
+    size_t DiffTiles(const std::vector<uint64_t>& hashes, const std::vector<uint64_t>& previous, std::vector<uint8_t>& dirty) const;
+    // Sum of squared differences between two frames, visiting only the dirty tiles
+    uint64_t SumSquaredDifferences(const void* img1, const void* img2, const std::vector<uint8_t>& dirty) const;
+    // Same as imagesDiffer, visiting only the dirty tiles. The MSE is still relative to the whole frame.
+    bool TilesDiffer(const void* img1, const void* img2, const std::vector<uint8_t>& dirty, double threshold) const;
+
+    // A tile signature holds the sums of the R, G and B components of each SIGNATURE_CELL_SIZE square cell of the tile, i.e. a
+    // thumbnail of the tile at 1/16 of its size. Since the squared differences of the pixels of a cell add up to at least
+    // the squared difference of their sums divided by the pixel count, signatures bound the SSD between frames from below.
+    //
+    // Recomputes the signatures of the dirty tiles of a frame with the box filter, returning the lower bound of the SSD
+    // between the frame and the frame the signatures came from. Signatures of the wrong size are computed for every tile,
+    // and the bound is then 0.
+    double UpdateSignatures(const void* pixels, const std::vector<uint8_t>& dirty, std::vector<uint16_t>& signatures) const;
+    // Coarse pass of a coarse-to-fine comparison against the frame before: like UpdateSignatures, but stops once the bound
+    // passes maxBound. The dirty tiles left behind are flagged in stale, and so are all tiles when the signatures have the
+    // wrong size. Stale signatures are refreshed by the next passes without adding to their bound, which so remains a lower
+    // bound of the SSD. Returns the bound reached.
+    double CompareSignatures(const void* pixels, const std::vector<uint8_t>& dirty, std::vector<uint16_t>& signatures,
+                             std::vector<uint8_t>& stale, double maxBound) const;
+
+private:
+    int iWidth;
+    int iHeight;
+    int iTileSize;
+    int iColumns;
+    int iRows;
+    int iCellsPerSide;
+    PixelFormat pfFormat;
+    size_t iPixelSize;
+    // Hashes of the band of tiles being hashed, kept so hashing an unchanged frame allocates nothing
+    mutable std::vector<TileHashState> vHashStates;
+    // Box filter sums of the tile whose signature is being computed
+    mutable std::vector<uint32_t> vSignatureSums;
+
+    uint64_t TileSumSquaredDifferences(const void* img1, const void* img2, size_t tile) const;
+    // Recomputes the signature of a tile, returning the SSD lower bound against its former value
+    double TileSignatureBound(const void* pixels, size_t tile, uint16_t* signature, std::vector<uint32_t>& sums,
+                              KernelIsa isa) const;
+};
+
+#endif
@@ -0,0 +1,169 @@
+// Stress tests the pieces the capture worker hands results through: the SPSC queue, with a producer and a consumer
+// thread wrapping a small ring millions of times, and the tick pacing of CaptureWorker when ticks overrun.
+#include "captureworker.h"
+#include "spscqueue.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Items pushed through the queue by the threaded test
+constexpr uint64_t STRESS_ITEM_COUNT = 4000000;
+// Small, so both sides keep finding the queue full or empty and the indexes wrap around often
+constexpr size_t STRESS_QUEUE_CAPACITY = 64;
+
+static int failureCount = 0;
+
+static void fail(const char* message, unsigned long long value = 0) {
+    fprintf(stderr, "captureworker-test: %s (%llu)\n", message, value);
+    failureCount++;
+}
+
+// Carries its sequence number twice, so a torn or stale slot shows up as a mismatch
+struct SequencedItem {
+    uint64_t iSequence;
+    uint64_t iCheck;
+};
+
+static uint64_t getCheck(uint64_t sequence) {
+    return sequence * 0x9E3779B97F4A7C15ull ^ 0xA5A5A5A5A5A5A5A5ull;
+}
+
+// Single thread: capacity rounding, full and empty queues, and the indexes wrapping past the end of the ring
+static void testQueueBounds() {
+    SpscQueue<uint64_t> queue(5);
+    if (queue.GetCapacity() != 8) {
+        fail("capacity not rounded up to a power of two", queue.GetCapacity());
+    }
+    uint64_t next = 0, expected = 0, item = 0;
+    for (int round = 0; round < 100; round++) {
+        // Fills the queue, checks it refuses one more, then empties it in two halves, one popped and one drained
+        while (queue.TryPush(next)) {
+            next++;
+        }
+        if (next - expected != queue.GetCapacity()) {
+            fail("full queue does not hold its capacity", next - expected);
+        }
+        for (size_t i = 0; i < queue.GetCapacity() / 2; i++) {
+            if (!queue.TryPop(item) || item != expected++) {
+                fail("pop out of order", item);
+            }
+        }
+        // Pushes into the slots just released, which wraps the tail past the end of the ring
+        if (!queue.TryPush(next++)) {
+            fail("push refused after pops", round);
+        }
+        queue.Drain(
+            [&](uint64_t value) {
+                if (value != expected++) {
+                    fail("drain out of order", value);
+                }
+            },
+            (size_t)-1);
+        if (!queue.IsEmpty() || queue.TryPop(item)) {
+            fail("queue not empty after drain", round);
+        }
+    }
+}
+
+// Two threads: every item arrives once and in order, whatever the interleaving
+static void testQueueThreads() {
+    SpscQueue<SequencedItem> queue(STRESS_QUEUE_CAPACITY);
+    uint64_t fullCount = 0;
+    std::thread producer([&]() {
+        for (uint64_t sequence = 0; sequence < STRESS_ITEM_COUNT; sequence++) {
+            while (!queue.TryPush({sequence, getCheck(sequence)})) {
+                fullCount++;
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint64_t expected = 0, emptyCount = 0, errors = 0;
+    auto check = [&](const SequencedItem& item) {
+        if (item.iSequence != expected || item.iCheck != getCheck(expected)) {
+            errors++;
+        }
+        expected++;
+    };
+    while (expected < STRESS_ITEM_COUNT) {
+        // Alternates single pops and batched drains, like the UI thread between messages
+        SequencedItem item;
+        if (expected & 1) {
+            if (queue.TryPop(item)) {
+                check(item);
+                continue;
+            }
+        } else if (queue.Drain(check, 17) > 0) {
+            continue;
+        }
+        emptyCount++;
+        std::this_thread::yield();
+    }
+    producer.join();
+    if (errors) {
+        fail("items lost, duplicated or out of order", errors);
+    }
+    if (!queue.IsEmpty()) {
+        fail("items left after the last one");
+    }
+    printf("queue: %llu items, producer found it full %llu times, consumer found it empty %llu times\n",
+           (unsigned long long)STRESS_ITEM_COUNT, (unsigned long long)fullCount, (unsigned long long)emptyCount);
+}
+
+// Ticks that overrun their interval must skip the deadlines already gone instead of running back to back
+static void testWorkerOverrun() {
+    using namespace std::chrono;
+    constexpr auto interval = milliseconds(2);
+    std::vector<CaptureWorker::TickTiming> timings;
+    timings.reserve(1000);
+    CaptureWorker worker;
+    worker.Start([&](const CaptureWorker::TickTiming& timing) -> CaptureWorker::Clock::duration {
+        timings.push_back(timing);
+        // Every fourth tick takes several intervals
+        if (timings.size() % 4 == 0) {
+            std::this_thread::sleep_for(interval * 5);
+        }
+        return interval;
+    });
+    std::this_thread::sleep_for(milliseconds(300));
+    worker.Stop();
+
+    uint64_t skipped = 0;
+    for (size_t i = 0; i < timings.size(); i++) {
+        skipped += timings[i].iSkippedTicks;
+        if (timings[i].tpStarted < timings[i].tpScheduled) {
+            fail("tick started before its deadline", i);
+        }
+        if (i > 0) {
+            // Deadlines stay on the interval grid, skipped ones included
+            const auto gap = timings[i].tpScheduled - timings[i - 1].tpScheduled;
+            if (gap != interval * (timings[i].iSkippedTicks + 1)) {
+                fail("deadline off the interval grid", i);
+            }
+            // Tick i - 1 overran when i is a multiple of 4
+            if (i % 4 == 0 && timings[i].iSkippedTicks == 0) {
+                fail("overrunning tick skipped no deadline", i);
+            }
+        }
+    }
+    if (worker.GetTickCount() != timings.size()) {
+        fail("tick count differs from the ticks run", worker.GetTickCount());
+    }
+    // The skips after the last tick are counted but never reported to a tick
+    if (worker.GetMissedTicks() < skipped || timings.size() < 8) {
+        fail("missed ticks not counted", worker.GetMissedTicks());
+    }
+    printf("worker: %zu ticks, %llu deadlines skipped\n", timings.size(), (unsigned long long)worker.GetMissedTicks());
+}
+
+int main() {
+    testQueueBounds();
+    testQueueThreads();
+    testWorkerOverrun();
+    if (failureCount) {
+        fprintf(stderr, "captureworker-test: %d failures\n", failureCount);
+        return 1;
+    }
+    return 0;
+}
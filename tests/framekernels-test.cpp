@@ -0,0 +1,318 @@
+// Checks the integer SSD kernels, at every instruction set the CPU supports, against the floating point mean square
+// error the capture loop computed before them: both must give the very same double. The kernels of every pixel format
+// are then checked against a plain per pixel decoding, and the channel order against colors worked out by hand.
+#include "framekernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static int failureCount = 0;
+
+static const char* getIsaName(KernelIsa isa) {
+    switch (isa) {
+    case KernelIsa::AVX2:
+        return "avx2";
+    case KernelIsa::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+// The original compareImages, with pow() per channel and a double accumulator
+static double compareImagesReference(const std::vector<uint32_t>& img1, const std::vector<uint32_t>& img2) {
+    if (img1.size() != img2.size()) {
+        return 0.0;
+    }
+    double meanSquareError = 0;
+    for (size_t i = 0; i < img1.size(); i++) {
+        uint8_t b1 = (img1[i] >> 16) & 0xFF;
+        uint8_t g1 = (img1[i] >> 8) & 0xFF;
+        uint8_t r1 = img1[i] & 0xFF;
+        uint8_t b2 = (img2[i] >> 16) & 0xFF;
+        uint8_t g2 = (img2[i] >> 8) & 0xFF;
+        uint8_t r2 = img2[i] & 0xFF;
+        meanSquareError += pow(r1 - r2, 2) + pow(g1 - g2, 2) + pow(b1 - b2, 2);
+    }
+    return meanSquareError / (3 * img1.size());
+}
+
+static void checkFrames(const char* name, const std::vector<uint32_t>& img1, const std::vector<uint32_t>& img2) {
+    const size_t count = img1.size();
+    const double expected = compareImagesReference(img1, img2);
+    for (int isa = (int)KernelIsa::Scalar; isa <= (int)getKernelIsa(); isa++) {
+        const uint64_t sum = sumSquaredDifferences(img1.data(), img2.data(), count, PixelFormat::BGRA32, (KernelIsa)isa);
+        const double mse = (double)sum / (3 * count);
+        if (mse != expected) {
+            fprintf(stderr, "framekernels-test: %s, %zu pixels, %s: MSE %.17g instead of %.17g\n", name, count,
+                    getIsaName((KernelIsa)isa), mse, expected);
+            failureCount++;
+        }
+    }
+    if (compareImages(img1, img2) != expected) {
+        fprintf(stderr, "framekernels-test: %s, %zu pixels: compareImages differs from the reference\n", name, count);
+        failureCount++;
+    }
+    for (double threshold : {0.0, 0.01, expected, 1000.0}) {
+        if (imagesDiffer(img1.data(), img2.data(), count, threshold) != (expected > threshold)) {
+            fprintf(stderr, "framekernels-test: %s, %zu pixels: imagesDiffer wrong at threshold %g\n", name, count, threshold);
+            failureCount++;
+        }
+    }
+}
+
+// Components of a pixel in R, G, B order, decoded one pixel at a time as the pixel formats are documented
+static void decodePixel(const uint8_t* pixel, PixelFormat format, int* rgb) {
+    switch (format) {
+    case PixelFormat::BGRA32:
+        rgb[0] = pixel[2];
+        rgb[1] = pixel[1];
+        rgb[2] = pixel[0];
+        break;
+    case PixelFormat::RGBA32:
+    case PixelFormat::RGB24:
+        rgb[0] = pixel[0];
+        rgb[1] = pixel[1];
+        rgb[2] = pixel[2];
+        break;
+    case PixelFormat::RGB565: {
+        // Each component widened to 8 bits by repeating its top bits below it
+        const int word = pixel[0] | (pixel[1] << 8);
+        const int red = word >> 11, green = (word >> 5) & 0x3F, blue = word & 0x1F;
+        rgb[0] = red * 8 + red / 4;
+        rgb[1] = green * 4 + green / 16;
+        rgb[2] = blue * 8 + blue / 4;
+        break;
+    }
+    case PixelFormat::Gray8:
+        rgb[0] = rgb[1] = rgb[2] = pixel[0];
+        break;
+    }
+}
+
+static FrameStats reduceFrameReference(const uint8_t* img, const uint8_t* reference, size_t count, PixelFormat format) {
+    const size_t pixelSize = getPixelSize(format);
+    FrameStats stats = {};
+    stats.iPixelCount = count;
+    for (auto& channel : stats.csChannels) {
+        channel.iMin = 0xFF;
+    }
+    for (size_t i = 0; i < count; i++) {
+        int rgb[3], referenceRgb[3];
+        decodePixel(img + i * pixelSize, format, rgb);
+        for (int c = 0; c < CHANNEL_COUNT; c++) {
+            auto& channel = stats.csChannels[c];
+            channel.iSum += rgb[c];
+            channel.iSumSquares += (uint64_t)(rgb[c] * rgb[c]);
+            channel.iMin = (uint8_t)(std::min)((int)channel.iMin, rgb[c]);
+            channel.iMax = (uint8_t)(std::max)((int)channel.iMax, rgb[c]);
+            channel.aHistogram[rgb[c] >> 4]++;
+        }
+        if (reference) {
+            decodePixel(reference + i * pixelSize, format, referenceRgb);
+            for (int c = 0; c < CHANNEL_COUNT; c++) {
+                stats.iSquaredDiffSum += (uint64_t)((rgb[c] - referenceRgb[c]) * (rgb[c] - referenceRgb[c]));
+            }
+        }
+    }
+    return stats;
+}
+
+static bool sameStats(const FrameStats& a, const FrameStats& b) {
+    if (a.iPixelCount != b.iPixelCount || a.iSquaredDiffSum != b.iSquaredDiffSum) {
+        return false;
+    }
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+        const auto &x = a.csChannels[c], &y = b.csChannels[c];
+        if (x.iSum != y.iSum || x.iSumSquares != y.iSumSquares || x.iMin != y.iMin || x.iMax != y.iMax ||
+            memcmp(x.aHistogram, y.aHistogram, sizeof(x.aHistogram)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void checkFormat(PixelFormat format, const std::vector<uint8_t>& img1, const std::vector<uint8_t>& img2, size_t count) {
+    const char* name = getPixelFormatName(format);
+    const FrameStats expected = reduceFrameReference(img1.data(), img2.data(), count, format);
+    const FrameStats expectedAlone = reduceFrameReference(img1.data(), nullptr, count, format);
+    for (int isa = (int)KernelIsa::Scalar; isa <= (int)getKernelIsa(); isa++) {
+        if (!sameStats(reduceFrame(img1.data(), img2.data(), count, format, (KernelIsa)isa), expected) ||
+            !sameStats(reduceFrame(img1.data(), nullptr, count, format, (KernelIsa)isa), expectedAlone)) {
+            fprintf(stderr, "framekernels-test: %s, %zu pixels, %s: reduceFrame differs from the reference\n", name, count,
+                    getIsaName((KernelIsa)isa));
+            failureCount++;
+        }
+        const uint64_t sum = sumSquaredDifferences(img1.data(), img2.data(), count, format, (KernelIsa)isa);
+        if (sum != expected.iSquaredDiffSum) {
+            fprintf(stderr, "framekernels-test: %s, %zu pixels, %s: sum %llu instead of %llu\n", name, count,
+                    getIsaName((KernelIsa)isa), (unsigned long long)sum, (unsigned long long)expected.iSquaredDiffSum);
+            failureCount++;
+        }
+    }
+    const double mse = expected.MeanSquareError();
+    for (double threshold : {0.0, mse / 2, mse, 1000.0}) {
+        if (imagesDiffer(img1.data(), img2.data(), count, threshold, format) != (mse > threshold)) {
+            fprintf(stderr, "framekernels-test: %s, %zu pixels: imagesDiffer wrong at threshold %g\n", name, count, threshold);
+            failureCount++;
+        }
+    }
+}
+
+// Box filter of an area narrower than its rows, with partial blocks at the right and bottom edges
+static void checkBoxFilter(PixelFormat format, const std::vector<uint8_t>& pixels, size_t stride, int width, int height) {
+    const size_t pixelSize = getPixelSize(format);
+    const int blocksPerRow = (width + BOX_FILTER_SIZE - 1) / BOX_FILTER_SIZE;
+    const int blockRows = (height + BOX_FILTER_SIZE - 1) / BOX_FILTER_SIZE;
+    std::vector<uint32_t> expected((size_t)blocksPerRow * blockRows * CHANNEL_COUNT);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int rgb[3];
+            decodePixel(pixels.data() + ((size_t)y * stride + x) * pixelSize, format, rgb);
+            const size_t block = (size_t)(y / BOX_FILTER_SIZE) * blocksPerRow + x / BOX_FILTER_SIZE;
+            for (int c = 0; c < CHANNEL_COUNT; c++) {
+                expected[block * CHANNEL_COUNT + c] += rgb[c];
+            }
+        }
+    }
+    for (int isa = (int)KernelIsa::Scalar; isa <= (int)getKernelIsa(); isa++) {
+        std::vector<uint32_t> sums(expected.size(), 0xDEADBEEF);
+        boxFilter(pixels.data(), stride, width, height, sums.data(), format, (KernelIsa)isa);
+        if (sums != expected) {
+            fprintf(stderr, "framekernels-test: %s, %dx%d, %s: boxFilter differs from the reference\n", getPixelFormatName(format),
+                    width, height, getIsaName((KernelIsa)isa));
+            failureCount++;
+        }
+    }
+}
+
+// One pixel of R 200, G 100, B 30 in each format (RGB565 and Gray8 get the nearest colors they hold), with the
+// COLORREF its average must come out as
+struct KnownColor {
+    PixelFormat pfFormat;
+    uint8_t aBytes[4];
+    uint32_t cAvgColor;
+};
+
+static const KnownColor KNOWN_COLORS[] = {
+    {PixelFormat::BGRA32, {30, 100, 200, 0}, 0x001E64C8},
+    {PixelFormat::RGBA32, {200, 100, 30, 0}, 0x001E64C8},
+    {PixelFormat::RGB24, {200, 100, 30}, 0x001E64C8},
+    // R 25, G 25, B 3 widened to 206, 101, 24
+    {PixelFormat::RGB565, {0x23, 0xCB}, 0x001865CE},
+    {PixelFormat::Gray8, {77}, 0x004D4D4D},
+};
+
+static void checkChannelOrder() {
+    for (const auto& color : KNOWN_COLORS) {
+        const size_t pixelSize = getPixelSize(color.pfFormat);
+        // Long enough for the SIMD loops, plus a tail
+        const size_t count = 67;
+        std::vector<uint8_t> frame(count * pixelSize);
+        for (size_t i = 0; i < count; i++) {
+            memcpy(&frame[i * pixelSize], color.aBytes, pixelSize);
+        }
+        for (int isa = (int)KernelIsa::Scalar; isa <= (int)getKernelIsa(); isa++) {
+            const FrameStats stats = reduceFrame(frame.data(), nullptr, count, color.pfFormat, (KernelIsa)isa);
+            const uint32_t avgColor = stats.AverageColor();
+            if (avgColor != color.cAvgColor || stats.Mean(CHANNEL_RED) != (color.cAvgColor & 0xFF) ||
+                stats.Mean(CHANNEL_BLUE) != ((color.cAvgColor >> 16) & 0xFF)) {
+                fprintf(stderr, "framekernels-test: %s, %s: average color %06X instead of %06X\n",
+                        getPixelFormatName(color.pfFormat), getIsaName((KernelIsa)isa), avgColor, color.cAvgColor);
+                failureCount++;
+            }
+        }
+    }
+}
+
+int main() {
+    std::mt19937 random(12345);
+    // Around the 4 and 8 pixel SIMD widths, so every tail length is covered, and a few larger frames
+    std::vector<size_t> counts;
+    for (size_t count = 1; count <= 33; count++) {
+        counts.push_back(count);
+    }
+    for (size_t count : {1000, 4099, 65543, 320 * 200}) {
+        counts.push_back(count);
+    }
+
+    for (size_t count : counts) {
+        std::vector<uint32_t> img1(count), img2(count);
+        for (size_t i = 0; i < count; i++) {
+            img1[i] = random();
+            img2[i] = random();
+        }
+        checkFrames("random", img1, img2);
+
+        // Small differences, like noise on a still image
+        for (size_t i = 0; i < count; i++) {
+            img2[i] = img1[i] ^ (random() & 0x03030303);
+        }
+        checkFrames("noise", img1, img2);
+
+        // The alpha byte is ignored, so frames that only differ there are equal
+        for (size_t i = 0; i < count; i++) {
+            img2[i] = img1[i] ^ (random() & 0xFF000000);
+        }
+        checkFrames("alpha", img1, img2);
+        for (int isa = (int)KernelIsa::Scalar; isa <= (int)getKernelIsa(); isa++) {
+            if (sumSquaredDifferences(img1.data(), img2.data(), count, PixelFormat::BGRA32, (KernelIsa)isa) != 0) {
+                fprintf(stderr, "framekernels-test: alpha, %zu pixels, %s: not zero\n", count, getIsaName((KernelIsa)isa));
+                failureCount++;
+            }
+        }
+    }
+
+    // Largest difference on every channel, over several SIMD accumulation blocks (16384 iterations of up to 8 pixels)
+    // plus a tail, where the 32-bit lane accumulators come closest to overflowing
+    for (size_t count : {16384 * 8 - 1, 16384 * 8, 16384 * 8 * 2 + 5, 16384 * 8 * 3 + 7}) {
+        const std::vector<uint32_t> black(count, 0x00000000), white(count, 0xFFFFFFFF);
+        checkFrames("worst case", black, white);
+        for (int isa = (int)KernelIsa::Scalar; isa <= (int)getKernelIsa(); isa++) {
+            const uint64_t sum = sumSquaredDifferences(black.data(), white.data(), count, PixelFormat::BGRA32, (KernelIsa)isa);
+            if (sum != 3ull * 255 * 255 * count) {
+                fprintf(stderr, "framekernels-test: worst case, %zu pixels, %s: sum %llu instead of %llu\n", count,
+                        getIsaName((KernelIsa)isa), (unsigned long long)sum, 3ull * 255 * 255 * count);
+                failureCount++;
+            }
+        }
+    }
+
+    checkChannelOrder();
+    for (PixelFormat format :
+         {PixelFormat::BGRA32, PixelFormat::RGBA32, PixelFormat::RGB24, PixelFormat::RGB565, PixelFormat::Gray8}) {
+        const size_t pixelSize = getPixelSize(format);
+        for (size_t count : counts) {
+            std::vector<uint8_t> img1(count * pixelSize), img2(count * pixelSize);
+            for (size_t i = 0; i < img1.size(); i++) {
+                img1[i] = (uint8_t)random();
+                img2[i] = (uint8_t)random();
+            }
+            checkFormat(format, img1, img2, count);
+            // Flat frames, where every pixel falls in the same histogram bins
+            std::fill(img2.begin(), img2.end(), (uint8_t)0xFF);
+            checkFormat(format, img2, img1, count);
+        }
+        std::vector<uint8_t> pixels(41 * 23 * pixelSize);
+        for (auto& byte : pixels) {
+            byte = (uint8_t)random();
+        }
+        for (int width : {1, 4, 13, 37}) {
+            checkBoxFilter(format, pixels, 41, width, 23);
+        }
+    }
+
+    if (getKernelIsa() != KernelIsa::AVX2) {
+        fprintf(stderr, "framekernels-test: the CPU lacks %s, not tested\n",
+                getKernelIsa() == KernelIsa::SSE2 ? "AVX2" : "SSE2 and AVX2");
+    }
+    if (failureCount) {
+        fprintf(stderr, "framekernels-test: %d failures\n", failureCount);
+        return 1;
+    }
+    return 0;
+}
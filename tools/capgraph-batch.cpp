@@ -0,0 +1,267 @@
+// Re-analyzes every frame recording (.cgrf) of a directory with new stillness settings, on all cores. Each session is
+// split in chunks of frames compared in parallel on a work stealing pool; the state machine then runs over the
+// comparisons of the session and its still images are written to a binary log (.cglog). A CSV summary of the sessions
+// is written next to the logs.
+#include "binarylog.h"
+#include "framefile.h"
+#include "stillnessengine.h"
+#include "taskpool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t DEFAULT_CHUNK_FRAMES = 256;
+
+static void printUsage() {
+    fprintf(stderr, "Usage: capgraph-batch [options] <directory>\n"
+                    "  --still-ms <ms>         Time an image must stay unchanged to be recorded (default 3000)\n"
+                    "  --threshold <mse>       Mean square error above which frames differ (default 0.01)\n"
+                    "  --sample-budget <n>     Pixels sampled per still image, 0 reads every pixel (default 0)\n"
+                    "  --signatures            Compares the frames with tile signatures instead of the previous frame\n"
+                    "  --sig-threshold <mse>   Threshold of the signature comparison (default 0.01)\n"
+                    "  --full-compare          Compares changed tiles at full resolution without the coarse level first\n"
+                    "  --threads <n>           Worker threads (default one per hardware thread)\n"
+                    "  --chunk-frames <n>      Frames compared per task (default 256)\n"
+                    "  --output <directory>    Writes the logs and summary.csv there instead of the input directory\n");
+}
+
+// State of a session shared by its tasks
+struct SessionJob {
+    std::string sPath;
+    std::string sName;
+    std::string sLogPath;
+    uint64_t iFileSize;
+    size_t iFrameCount;
+    int iWidth;
+    int iHeight;
+    // Comparison result of each frame, filled by the chunks
+    std::vector<uint8_t> vChanged;
+    std::atomic<size_t> iChunksLeft;
+    // Frames before the first one that could not be read
+    std::atomic<size_t> iValidFrames;
+    size_t iChangedFrames;
+    uint64_t iItemCount;
+    const char* szStatus;
+    Clock::time_point tpStarted;
+    Clock::time_point tpFinished;
+};
+
+// Lowers value to candidate if it is smaller
+static void storeMin(std::atomic<size_t>& value, size_t candidate) {
+    size_t current = value.load(std::memory_order_relaxed);
+    while (candidate < current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+    }
+}
+
+// Runs the state machine over the comparisons and logs the still images, reading back only their frames
+static void finishSession(SessionJob& job, const EngineSettings& settings) {
+    const size_t frameCount = job.iValidFrames.load(std::memory_order_relaxed);
+    auto reader = FrameFileReader::Open(job.sPath);
+    auto log = BinaryLogWriter::Create(job.sLogPath, true);
+    if (!reader || !log) {
+        job.szStatus = "unwritable";
+        job.tpFinished = Clock::now();
+        return;
+    }
+    const size_t pixelCount = reader->GetPixelCount();
+    const bool withPrevious = settings.rmReference == ReferenceMode::Frame;
+    std::vector<uint32_t> frame(pixelCount);
+    std::vector<uint32_t> previous(withPrevious ? pixelCount : 0);
+    StillnessTracker tracker;
+    tracker.Start();
+    job.iChangedFrames = 0;
+    job.iItemCount = 0;
+    bool readable = frameCount == job.iFrameCount;
+    for (size_t f = 0; f < frameCount; f++) {
+        job.iChangedFrames += job.vChanged[f];
+        const int64_t timestamp = reader->GetTimestamp(f);
+        if (tracker.Update(job.vChanged[f] != 0, timestamp, settings.iStillDuration) != StillnessEvent::StillImage) {
+            continue;
+        }
+        int64_t frameTimestamp;
+        const bool hasPrevious = withPrevious && f > 0;
+        reader->SeekFrame(hasPrevious ? f - 1 : f);
+        if ((hasPrevious && !reader->ReadFrame(previous.data(), frameTimestamp)) || !reader->ReadFrame(frame.data(), frameTimestamp)) {
+            readable = false;
+            break;
+        }
+        log->Append(getStillImageItem(frame.data(), hasPrevious ? previous.data() : nullptr, pixelCount, timestamp, 0, settings));
+        job.iItemCount++;
+    }
+    const bool logged = log->Close();
+    job.szStatus = !logged ? "unwritable" : !readable ? "damaged" : !reader->IsComplete() ? "unclosed" : "ok";
+    job.tpFinished = Clock::now();
+}
+
+// Compares the frames [begin, end) of a session, starting from the frame before so the first one has its reference.
+// The last chunk to finish completes the session.
+static void compareChunk(SessionJob& job, const EngineSettings& settings, size_t begin, size_t end) {
+    const size_t first = begin > 0 ? begin - 1 : 0;
+    auto reader = FrameFileReader::Open(job.sPath);
+    if (!reader || !reader->SeekFrame(first)) {
+        storeMin(job.iValidFrames, first);
+    } else {
+        std::vector<uint32_t> frames[2] = {std::vector<uint32_t>(reader->GetPixelCount()),
+                                           std::vector<uint32_t>(reader->GetPixelCount())};
+        StillnessEngine engine;
+        for (size_t f = first; f < end; f++) {
+            int64_t timestamp;
+            if (!reader->ReadFrame(frames[f % 2].data(), timestamp)) {
+                storeMin(job.iValidFrames, f);
+                break;
+            }
+            const uint32_t* previous = f > first ? frames[(f - 1) % 2].data() : nullptr;
+            const bool changed = engine.CompareFrame(frames[f % 2].data(), previous, job.iWidth, job.iHeight, settings);
+            if (f >= begin) {
+                job.vChanged[f] = changed;
+            }
+        }
+    }
+    if (job.iChunksLeft.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        finishSession(job, settings);
+    }
+}
+
+// Splits a session in chunks, queued on the pool thread running this task for the other threads to steal
+static void startSession(TaskPool& pool, SessionJob& job, const EngineSettings& settings, size_t chunkFrames) {
+    job.tpStarted = Clock::now();
+    auto reader = FrameFileReader::Open(job.sPath);
+    if (!reader) {
+        job.szStatus = "unreadable";
+        job.tpFinished = Clock::now();
+        return;
+    }
+    job.iFrameCount = reader->GetFrameCount();
+    job.iWidth = reader->GetWidth();
+    job.iHeight = reader->GetHeight();
+    job.vChanged.assign(job.iFrameCount, 0);
+    job.iValidFrames.store(job.iFrameCount, std::memory_order_relaxed);
+    const size_t chunkCount = (std::max)((job.iFrameCount + chunkFrames - 1) / chunkFrames, (size_t)1);
+    job.iChunksLeft.store(chunkCount, std::memory_order_relaxed);
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        const size_t begin = chunk * chunkFrames;
+        const size_t end = (std::min)(begin + chunkFrames, job.iFrameCount);
+        pool.Submit([&job, &settings, begin, end]() { compareChunk(job, settings, begin, end); });
+    }
+}
+
+int main(int argc, char** argv) {
+    EngineSettings settings;
+    std::string inputPath;
+    std::string outputPath;
+    size_t threadCount = TaskPool::DefaultThreadCount();
+    size_t chunkFrames = DEFAULT_CHUNK_FRAMES;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--still-ms") && hasValue) {
+            settings.iStillDuration = atoll(argv[++i]) * FILE_TIME_TO_MILLISECONDS;
+        } else if (!strcmp(argv[i], "--threshold") && hasValue) {
+            settings.dChangeThreshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sample-budget") && hasValue) {
+            settings.iSampleBudget = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--sig-threshold") && hasValue) {
+            settings.dSignatureThreshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--signatures")) {
+            settings.rmReference = ReferenceMode::TileSignatures;
+        } else if (!strcmp(argv[i], "--full-compare")) {
+            settings.bCoarseToFine = false;
+        } else if (!strcmp(argv[i], "--threads") && hasValue) {
+            threadCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--chunk-frames") && hasValue) {
+            chunkFrames = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--output") && hasValue) {
+            outputPath = argv[++i];
+        } else if (argv[i][0] != '-' && inputPath.empty()) {
+            inputPath = argv[i];
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (inputPath.empty() || threadCount == 0 || chunkFrames == 0) {
+        printUsage();
+        return 2;
+    }
+    if (outputPath.empty()) {
+        outputPath = inputPath;
+    }
+    std::error_code error;
+    fs::create_directories(outputPath, error);
+
+    // Largest sessions first, so the last tasks left are small ones
+    std::vector<std::unique_ptr<SessionJob>> jobs;
+    for (fs::directory_iterator it(inputPath, error), end; !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file(error) || it->path().extension() != ".cgrf") {
+            continue;
+        }
+        std::unique_ptr<SessionJob> job(new SessionJob());
+        job->sPath = it->path().string();
+        job->sName = it->path().filename().string();
+        job->sLogPath = (fs::path(outputPath) / it->path().stem()).string() + ".cglog";
+        job->iFileSize = (uint64_t)it->file_size(error);
+        job->iFrameCount = 0;
+        job->iWidth = 0;
+        job->iHeight = 0;
+        job->iChangedFrames = 0;
+        job->iItemCount = 0;
+        job->szStatus = "unreadable";
+        job->iChunksLeft.store(0, std::memory_order_relaxed);
+        job->iValidFrames.store(0, std::memory_order_relaxed);
+        jobs.push_back(std::move(job));
+    }
+    if (error) {
+        fprintf(stderr, "capgraph-batch: can't list %s: %s\n", inputPath.c_str(), error.message().c_str());
+        return 1;
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const std::unique_ptr<SessionJob>& a, const std::unique_ptr<SessionJob>& b) {
+        return a->iFileSize > b->iFileSize;
+    });
+
+    const auto start = Clock::now();
+    {
+        TaskPool pool(threadCount);
+        for (auto& job : jobs) {
+            SessionJob* session = job.get();
+            pool.Submit([&pool, session, &settings, chunkFrames]() { startSession(pool, *session, settings, chunkFrames); });
+        }
+        pool.Wait();
+        fprintf(stderr, "%llu tasks stolen\n", (unsigned long long)pool.GetStealCount());
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const std::string summaryPath = (fs::path(outputPath) / "summary.csv").string();
+    std::ofstream summary(summaryPath);
+    if (!summary) {
+        fprintf(stderr, "capgraph-batch: can't create %s\n", summaryPath.c_str());
+        return 1;
+    }
+    summary << "session,status,frames,width,height,changed_frames,items,seconds\n";
+    uint64_t totalFrames = 0;
+    uint64_t totalItems = 0;
+    size_t failedSessions = 0;
+    for (const auto& job : jobs) {
+        const double jobSeconds = std::chrono::duration<double>(job->tpFinished - job->tpStarted).count();
+        summary << job->sName << "," << job->szStatus << "," << job->iFrameCount << "," << job->iWidth << "," << job->iHeight << ","
+                << job->iChangedFrames << "," << job->iItemCount << "," << jobSeconds << "\n";
+        totalFrames += job->iValidFrames.load(std::memory_order_relaxed);
+        totalItems += job->iItemCount;
+        // Recordings that were not closed are still read up to their last complete frame
+        failedSessions += strcmp(job->szStatus, "ok") != 0 && strcmp(job->szStatus, "unclosed") != 0;
+    }
+    fprintf(stderr, "%llu sessions (%llu failed), %llu frames, %llu items, %.3f s, %.1f frames/s on %llu threads\n",
+            (unsigned long long)jobs.size(), (unsigned long long)failedSessions, (unsigned long long)totalFrames,
+            (unsigned long long)totalItems, seconds, seconds > 0 ? totalFrames / seconds : 0.0, (unsigned long long)threadCount);
+    return failedSessions ? 1 : 0;
+}
@@ -0,0 +1,377 @@
+// Microbenchmarks of the frame kernels, the formatters and the exporters, run over synthetic frames and item lists.
+// Results are written as CSV, one line per benchmark and size, so runs can be compared with any tool.
+#include "binarylog.h"
+#include "captureformat.h"
+#include "captureitemmodel.h"
+#include "csvwriter.h"
+#include "framefile.h"
+#include "framekernels.h"
+#include "tilegrid.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct FrameSize {
+    int iWidth;
+    int iHeight;
+};
+
+static const FrameSize FRAME_SIZES[] = {{16, 16}, {64, 64}, {256, 256}, {640, 480}, {1920, 1080}, {3840, 2160}};
+
+struct BenchOptions {
+    std::string sFilter;
+    double dMinSeconds = 0.2;
+    size_t iRowCount = 1000000;
+    std::string sScratchPath = "capgraph-bench.tmp";
+};
+
+// Keeps the results of the benchmarked calls alive, so the compiler can't drop them
+static volatile uint64_t benchSink;
+
+static void printUsage() {
+    fprintf(stderr, "Usage: capgraph-bench [options]\n"
+                    "  --filter <text>         Only runs the benchmarks whose name contains text\n"
+                    "  --min-ms <ms>           Minimum time spent measuring each benchmark (default 200)\n"
+                    "  --rows <n>              Rows of the item list benchmarks (default 1000000)\n"
+                    "  --scratch <file>        File written by the recorder and exporter benchmarks (default capgraph-bench.tmp)\n"
+                    "  --output <file.csv>     Writes the results to a file instead of the standard output\n");
+}
+
+static uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Random pixels, with alpha set like the GDI captures
+static std::vector<uint32_t> getNoiseFrame(size_t count, uint64_t seed) {
+    std::vector<uint32_t> frame(count);
+    for (auto& pixel : frame) {
+        pixel = (uint32_t)splitMix64(seed) | 0xFF000000u;
+    }
+    return frame;
+}
+
+// Single color with a little noise in the low bits, like a still screen area
+static std::vector<uint32_t> getFlatFrame(size_t count, uint64_t seed) {
+    std::vector<uint32_t> frame(count);
+    for (auto& pixel : frame) {
+        pixel = 0xFF406080u + ((uint32_t)splitMix64(seed) & 0x00010101u);
+    }
+    return frame;
+}
+
+static std::vector<CaptureItem> getItems(size_t count) {
+    std::vector<CaptureItem> items(count);
+    uint64_t seed = 1;
+    int64_t timestamp = getCurrentFileTime();
+    for (size_t i = 0; i < count; i++) {
+        timestamp += (int64_t)(splitMix64(seed) % 100000000ull);
+        items[i].iTimestamp = timestamp;
+        items[i].cAvgColor = (uint32_t)splitMix64(seed) & 0xFFFFFF;
+        items[i].iRegion = (uint32_t)(i % 4);
+    }
+    return items;
+}
+
+class BenchRunner {
+public:
+    BenchRunner(const BenchOptions& options, std::ostream& output)
+        : boOptions(options)
+        , osOutput(output) {
+        osOutput << "benchmark,width,height,rows,iterations,ns_per_op,ns_per_pixel,gb_per_s,rows_per_s\n";
+    }
+
+    // Runs a frame benchmark; bytes is the memory read per call
+    void RunFrame(const std::string& name, const FrameSize& size, size_t bytes, const std::function<void()>& body) {
+        if (!IsSelected(name)) {
+            return;
+        }
+        const size_t pixels = (size_t)size.iWidth * size.iHeight;
+        uint64_t iterations;
+        const double ns = Measure(body, iterations);
+        char line[256];
+        snprintf(line, sizeof(line), "%s,%d,%d,,%llu,%.1f,%.4f,%.3f,\n", name.c_str(), size.iWidth, size.iHeight,
+                 (unsigned long long)iterations, ns, ns / pixels, bytes / ns);
+        osOutput << line << std::flush;
+    }
+
+    // Runs a benchmark going over rows items per call; bytes is the output produced per call
+    void RunRows(const std::string& name, size_t rows, size_t bytes, const std::function<void()>& body) {
+        if (!IsSelected(name)) {
+            return;
+        }
+        uint64_t iterations;
+        const double ns = Measure(body, iterations);
+        char line[256];
+        snprintf(line, sizeof(line), "%s,,,%zu,%llu,%.1f,,%.3f,%.0f\n", name.c_str(), rows, (unsigned long long)iterations, ns,
+                 bytes / ns, rows / ns * 1e9);
+        osOutput << line << std::flush;
+    }
+
+private:
+    bool IsSelected(const std::string& name) const {
+        return boOptions.sFilter.empty() || name.find(boOptions.sFilter) != std::string::npos;
+    }
+
+    // Calls body until the minimum time is spent, after a warm up call. Returns the mean time of a call in ns.
+    double Measure(const std::function<void()>& body, uint64_t& iterations) const {
+        body();
+        iterations = 0;
+        uint64_t batch = 1;
+        const auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            for (uint64_t i = 0; i < batch; i++) {
+                body();
+            }
+            iterations += batch;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            batch *= 2;
+        } while (elapsed < boOptions.dMinSeconds);
+        return elapsed * 1e9 / iterations;
+    }
+
+    const BenchOptions& boOptions;
+    std::ostream& osOutput;
+};
+
+static const char* getIsaName(KernelIsa isa) {
+    switch (isa) {
+    case KernelIsa::AVX2:
+        return "avx2";
+    case KernelIsa::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+static void runFrameBenchmarks(BenchRunner& runner, const BenchOptions& options) {
+    const KernelIsa bestIsa = getKernelIsa();
+    for (const auto& size : FRAME_SIZES) {
+        const size_t count = (size_t)size.iWidth * size.iHeight;
+        const size_t frameBytes = count * sizeof(uint32_t);
+        const auto frame = getNoiseFrame(count, 1);
+        const auto reference = frame;
+        const auto flatFrame = getFlatFrame(count, 2);
+        const auto flatReference = getFlatFrame(count, 3);
+
+        runner.RunFrame("compareImages", size, 2 * frameBytes, [&]() { benchSink = (uint64_t)compareImages(frame, reference); });
+        for (int isa = (int)KernelIsa::Scalar; isa <= (int)bestIsa; isa++) {
+            runner.RunFrame(std::string("sumSquaredDifferences/") + getIsaName((KernelIsa)isa), size, 2 * frameBytes, [&]() {
+                benchSink = sumSquaredDifferences(frame.data(), reference.data(), count, PixelFormat::BGRA32, (KernelIsa)isa);
+            });
+        }
+        // Equal frames are the worst case of the early exit, since every block is read
+        runner.RunFrame("imagesDiffer", size, 2 * frameBytes,
+                        [&]() { benchSink = imagesDiffer(frame.data(), reference.data(), count, 0.01); });
+        for (int isa = (int)KernelIsa::Scalar; isa <= (int)bestIsa; isa++) {
+            runner.RunFrame(std::string("reduceFrame/") + getIsaName((KernelIsa)isa), size, 2 * frameBytes, [&]() {
+                benchSink = reduceFrame(frame.data(), reference.data(), count, PixelFormat::BGRA32, (KernelIsa)isa).iSquaredDiffSum;
+            });
+        }
+        // The other formats, read from the first bytes of the same noise
+        for (const PixelFormat format : {PixelFormat::RGBA32, PixelFormat::RGB24, PixelFormat::RGB565, PixelFormat::Gray8}) {
+            runner.RunFrame(std::string("reduceFrame/") + getPixelFormatName(format), size, 2 * count * getPixelSize(format),
+                            [&]() { benchSink = reduceFrame(frame.data(), reference.data(), count, format).iSquaredDiffSum; });
+        }
+        runner.RunFrame("reduceFrameSampled/flat", size, 2 * frameBytes, [&]() {
+            benchSink = reduceFrameSampled(flatFrame.data(), flatReference.data(), count, 4096, 1).iSquaredDiffSum;
+        });
+        runner.RunFrame("reduceFrameSampled/noise", size, 2 * frameBytes, [&]() {
+            benchSink = reduceFrameSampled(frame.data(), reference.data(), count, 4096, 1).iSquaredDiffSum;
+        });
+
+        const TileGrid grid(size.iWidth, size.iHeight);
+        std::vector<uint64_t> hashes;
+        runner.RunFrame("TileGrid::HashTiles", size, frameBytes, [&]() {
+            grid.HashTiles(frame.data(), hashes);
+            benchSink = hashes[0];
+        });
+        const std::vector<uint8_t> dirty(grid.GetTileCount(), 1);
+        runner.RunFrame("TileGrid::SumSquaredDifferences", size, 2 * frameBytes,
+                        [&]() { benchSink = grid.SumSquaredDifferences(frame.data(), reference.data(), dirty); });
+        std::vector<uint16_t> signatures;
+        grid.UpdateSignatures(frame.data(), dirty, signatures);
+        runner.RunFrame("TileGrid::UpdateSignatures", size, frameBytes,
+                        [&]() { benchSink = (uint64_t)grid.UpdateSignatures(frame.data(), dirty, signatures); });
+
+        const int blocksPerRow = (size.iWidth + BOX_FILTER_SIZE - 1) / BOX_FILTER_SIZE;
+        const int blockRows = (size.iHeight + BOX_FILTER_SIZE - 1) / BOX_FILTER_SIZE;
+        std::vector<uint32_t> boxes((size_t)blocksPerRow * blockRows * CHANNEL_COUNT);
+        for (int isa = (int)KernelIsa::Scalar; isa <= (int)bestIsa; isa++) {
+            runner.RunFrame(std::string("boxFilter/") + getIsaName((KernelIsa)isa), size, frameBytes, [&]() {
+                boxFilter(frame.data(), size.iWidth, size.iWidth, size.iHeight, boxes.data(), PixelFormat::BGRA32, (KernelIsa)isa);
+                benchSink = boxes[0];
+            });
+        }
+
+        // Recording an unchanged screen, after the first key frame, and reading it back in order
+        if (auto recorder = FrameFileWriter::Create(options.sScratchPath, size.iWidth, size.iHeight)) {
+            recorder->WriteFrame(frame.data(), 0);
+            runner.RunFrame("FrameFileWriter::WriteFrame/still", size, frameBytes,
+                            [&]() { benchSink = recorder->WriteFrame(frame.data(), 0); });
+        }
+        if (auto reader = FrameFileReader::Open(options.sScratchPath)) {
+            std::vector<uint32_t> pixels(count);
+            runner.RunFrame("FrameFileReader::ReadFrame/still", size, frameBytes, [&]() {
+                int64_t timestamp;
+                if (!reader->ReadFrame(pixels.data(), timestamp)) {
+                    reader->SeekFrame(0);
+                }
+                benchSink = pixels[0];
+            });
+        }
+        remove(options.sScratchPath.c_str());
+    }
+}
+
+static void runRowBenchmarks(BenchRunner& runner, const BenchOptions& options) {
+    const auto items = getItems(options.iRowCount);
+    const size_t rows = items.size();
+    const std::string delimiter = ",";
+    size_t lineBytes = 0;
+    for (const auto& item : items) {
+        lineBytes += formatCaptureLine(item, delimiter).size();
+    }
+
+    runner.RunRows("formatCaptureItemTimestamp/char", rows, rows * 19, [&]() {
+        char buffer[CAPTURE_TIMESTAMP_MAX_LENGTH];
+        uint64_t length = 0;
+        for (const auto& item : items) {
+            length += formatCaptureItemTimestamp(item, buffer) - buffer;
+        }
+        benchSink = length;
+    });
+    runner.RunRows("formatCaptureItemTimestamp/wchar_t", rows, rows * 19 * sizeof(wchar_t), [&]() {
+        wchar_t buffer[CAPTURE_TIMESTAMP_MAX_LENGTH];
+        uint64_t length = 0;
+        for (const auto& item : items) {
+            length += formatCaptureItemTimestamp(item, buffer) - buffer;
+        }
+        benchSink = length;
+    });
+    runner.RunRows("formatCaptureItemColor/char", rows, rows * 7, [&]() {
+        char buffer[CAPTURE_COLOR_MAX_LENGTH];
+        uint64_t length = 0;
+        for (const auto& item : items) {
+            length += formatCaptureItemColor(item, buffer) - buffer;
+        }
+        benchSink = length;
+    });
+    runner.RunRows("formatCaptureLine/buffer", rows, lineBytes, [&]() {
+        char buffer[getCaptureLineMaxLength(1)];
+        uint64_t length = 0;
+        for (const auto& item : items) {
+            length += formatCaptureLine(item, delimiter.data(), delimiter.size(), buffer) - buffer;
+        }
+        benchSink = length;
+    });
+    runner.RunRows("formatCaptureLine/string", rows, lineBytes, [&]() {
+        uint64_t length = 0;
+        for (const auto& item : items) {
+            length += formatCaptureLine(item, delimiter).size();
+        }
+        benchSink = length;
+    });
+    runner.RunRows("writeCaptureLine/ostringstream", rows, lineBytes, [&]() {
+        std::ostringstream output;
+        for (const auto& item : items) {
+            writeCaptureLine(output, item, delimiter);
+        }
+        benchSink = (uint64_t)output.tellp();
+    });
+    runner.RunRows("CaptureItemModel::Append", rows, rows * sizeof(CaptureRow), [&]() {
+        CaptureItemModel model;
+        for (const auto& item : items) {
+            model.Append(item);
+        }
+        benchSink = model.GetRowCount();
+    });
+
+    // The exporters write to a real file, so their figures include the file system
+    runner.RunRows("CaptureCsvWriter", rows, lineBytes, [&]() {
+        auto csvFile = CaptureCsvWriter::Create(options.sScratchPath, delimiter, false);
+        for (size_t i = 0; csvFile && i < rows; i++) {
+            csvFile->Append(items[i]);
+        }
+    });
+    for (int withStats = 0; withStats <= 1; withStats++) {
+        runner.RunRows(withStats ? "BinaryLogWriter/stats" : "BinaryLogWriter", rows, rows * sizeof(CaptureItem), [&]() {
+            auto logFile = BinaryLogWriter::Create(options.sScratchPath, withStats != 0);
+            for (size_t i = 0; logFile && i < rows; i++) {
+                logFile->Append(items[i]);
+            }
+        });
+    }
+    if (auto logFile = BinaryLogWriter::Create(options.sScratchPath, true)) {
+        for (const auto& item : items) {
+            logFile->Append(item);
+        }
+        logFile->Close();
+    }
+    runner.RunRows("BinaryLogReader::ReadBlock", rows, rows * sizeof(LogEntry), [&]() {
+        auto reader = BinaryLogReader::Open(options.sScratchPath);
+        std::vector<LogEntry> entries;
+        uint64_t count = 0;
+        for (size_t block = 0; reader && block < reader->GetBlockCount(); block++) {
+            entries.clear();
+            if (reader->ReadBlock(block, entries)) {
+                count += entries.size();
+            }
+        }
+        benchSink = count;
+    });
+    remove(options.sScratchPath.c_str());
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::string outputPath;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--filter") && hasValue) {
+            options.sFilter = argv[++i];
+        } else if (!strcmp(argv[i], "--min-ms") && hasValue) {
+            options.dMinSeconds = atof(argv[++i]) / 1000;
+        } else if (!strcmp(argv[i], "--rows") && hasValue) {
+            options.iRowCount = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--scratch") && hasValue) {
+            options.sScratchPath = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && hasValue) {
+            outputPath = argv[++i];
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (options.iRowCount == 0) {
+        printUsage();
+        return 2;
+    }
+    std::ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile) {
+            fprintf(stderr, "capgraph-bench: can't create %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
+    std::ostream& output = outputPath.empty() ? std::cout : outputFile;
+    fprintf(stderr, "Kernels: %s\n", getIsaName(getKernelIsa()));
+    BenchRunner runner(options, output);
+    runFrameBenchmarks(runner, options);
+    runRowBenchmarks(runner, options);
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Runs the still image engine on raw frames written to FIFOs, pipes or the standard input by other programs, one region
+// per stream, all served by a single thread, and writes the items as CSV as they are recorded.
+#include "captureformat.h"
+#include "capturetelemetry.h"
+#include "framestream.h"
+#include "sharedring.h"
+#include "stillnessengine.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage() {
+    fprintf(stderr, "Usage: capgraph-ingest [options] --size <w>x<h> <fifo|-> [[--size <w>x<h>] <fifo|-> ...]\n"
+                    "  --size <w>x<h>          Frame size of the streams that follow\n"
+                    "  --format <name>         Pixel format of the streams that follow: bgra32 (default), rgba32, rgb24,\n"
+                    "                          rgb565 or gray8\n"
+                    "  --still-ms <ms>         Time an image must stay unchanged to be recorded (default 3000)\n"
+                    "  --threshold <mse>       Mean square error above which frames differ (default 0.01)\n"
+                    "  --sample-budget <n>     Pixels sampled per still image, 0 reads every pixel (default 0)\n"
+                    "  --delimiter <c>         CSV delimiter (default ,)\n"
+                    "  --signatures            Compares the frames with tile signatures instead of the previous frame\n"
+                    "  --sig-threshold <mse>   Threshold of the signature comparison (default 0.01)\n"
+                    "  --full-compare          Compares changed tiles at full resolution without the coarse level first\n"
+                    "  --telemetry             Prints the latencies of the engine stages when done\n"
+                    "  --output <file.csv>     Writes the items to a file instead of the standard output\n"
+                    "  --publish <name>        Also publishes the items, with their statistics, to a shared memory ring\n"
+                    "Streams are numbered as regions in the order given; - reads the standard input.\n");
+}
+
+struct StreamSpec {
+    std::string sPath;
+    int iWidth;
+    int iHeight;
+    PixelFormat pfFormat;
+};
+
+int main(int argc, char** argv) {
+    EngineSettings settings;
+    std::string delimiter = ",";
+    std::string outputPath;
+    std::string ringName;
+    std::vector<StreamSpec> specs;
+    int width = 0;
+    int height = 0;
+    PixelFormat format = PixelFormat::BGRA32;
+    bool withTelemetry = false;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--size") && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                fprintf(stderr, "capgraph-ingest: bad frame size %s\n", argv[i]);
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--format") && hasValue) {
+            if (!parsePixelFormat(argv[++i], format)) {
+                fprintf(stderr, "capgraph-ingest: unknown pixel format %s\n", argv[i]);
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--still-ms") && hasValue) {
+            settings.iStillDuration = atoll(argv[++i]) * FILE_TIME_TO_MILLISECONDS;
+        } else if (!strcmp(argv[i], "--threshold") && hasValue) {
+            settings.dChangeThreshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sample-budget") && hasValue) {
+            settings.iSampleBudget = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--delimiter") && hasValue) {
+            delimiter = argv[++i];
+        } else if (!strcmp(argv[i], "--sig-threshold") && hasValue) {
+            settings.dSignatureThreshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--signatures")) {
+            settings.rmReference = ReferenceMode::TileSignatures;
+        } else if (!strcmp(argv[i], "--full-compare")) {
+            settings.bCoarseToFine = false;
+        } else if (!strcmp(argv[i], "--telemetry")) {
+            withTelemetry = true;
+        } else if (!strcmp(argv[i], "--output") && hasValue) {
+            outputPath = argv[++i];
+        } else if (!strcmp(argv[i], "--publish") && hasValue) {
+            ringName = argv[++i];
+        } else if ((argv[i][0] != '-' || !strcmp(argv[i], "-")) && width > 0) {
+            specs.push_back({argv[i], width, height, format});
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (specs.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    auto poller = StreamPoller::Create();
+    if (!poller) {
+        fprintf(stderr, "capgraph-ingest: can't create the stream poller\n");
+        return 1;
+    }
+    // Two frame buffers per stream used alternately, or a single one with tile signatures, like the capture session
+    const int bufferCount = settings.rmReference == ReferenceMode::Frame ? 2 : 1;
+    std::vector<std::shared_ptr<FrameStream>> streams;
+    std::vector<std::unique_ptr<StillnessEngine>> engines;
+    for (size_t i = 0; i < specs.size(); i++) {
+        auto stream = FrameStream::Open(specs[i].sPath, specs[i].iWidth, specs[i].iHeight, specs[i].pfFormat, bufferCount);
+        if (!stream) {
+            fprintf(stderr, "capgraph-ingest: can't open %s\n", specs[i].sPath.c_str());
+            return 1;
+        }
+        if (!poller->Add(stream->GetDescriptor(), i)) {
+            fprintf(stderr, "capgraph-ingest: %s is not a pipe or a FIFO\n", specs[i].sPath.c_str());
+            return 1;
+        }
+        streams.push_back(stream);
+        engines.emplace_back(new StillnessEngine((uint32_t)i));
+        engines.back()->Start();
+    }
+
+    std::shared_ptr<SharedRingWriter> ring;
+    if (!ringName.empty()) {
+        ring = SharedRingWriter::Create(ringName, true);
+        if (!ring) {
+            fprintf(stderr, "capgraph-ingest: can't create the shared memory ring %s, or another capture publishes it\n",
+                    ringName.c_str());
+            return 1;
+        }
+    }
+
+    std::ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile) {
+            fprintf(stderr, "capgraph-ingest: can't create %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
+    std::ostream& output = outputPath.empty() ? std::cout : outputFile;
+    writeCaptureHeader(output, delimiter);
+    output.flush();
+
+    CaptureTelemetry telemetry;
+    if (withTelemetry) {
+        settings.pTelemetry = &telemetry;
+    }
+    size_t openStreams = streams.size();
+    std::vector<size_t> ready;
+    int result = 0;
+    while (openStreams > 0) {
+        if (!poller->Wait(-1, ready)) {
+            fprintf(stderr, "capgraph-ingest: waiting for the streams failed\n");
+            return 1;
+        }
+        for (size_t index : ready) {
+            FrameStream& stream = *streams[index];
+            const StreamStatus status = stream.Read();
+            if (status == StreamStatus::FrameReady) {
+                StillnessEngine& engine = *engines[index];
+                settings.pfFormat = stream.GetFormat();
+                if (engine.ProcessFrame(stream.GetFrame(), stream.GetPreviousFrame(), stream.GetWidth(), stream.GetHeight(),
+                                        stream.GetTimestamp(), settings) &&
+                    engine.GetEvent().seType == StillnessEvent::StillImage) {
+                    // Flushed per item, so whatever reads the output sees them as they are recorded
+                    writeCaptureLine(output, engine.GetEvent().ciItem, delimiter);
+                    output.flush();
+                    if (ring) {
+                        ring->Publish(engine.GetEvent().ciItem);
+                    }
+                }
+            } else if (status == StreamStatus::Ended || status == StreamStatus::Failed) {
+                if (status == StreamStatus::Failed) {
+                    fprintf(stderr, "capgraph-ingest: can't read %s\n", stream.GetPath().c_str());
+                    result = 1;
+                }
+                fprintf(stderr, "%s: %llu frames (%dx%d %s)\n", stream.GetPath().c_str(), (unsigned long long)stream.GetFrameCount(),
+                        stream.GetWidth(), stream.GetHeight(), getPixelFormatName(stream.GetFormat()));
+                poller->Remove(stream.GetDescriptor());
+                openStreams--;
+            }
+        }
+    }
+    if (withTelemetry) {
+        fprintf(stderr, "\n%s", formatTelemetryReport(telemetry.GetSnapshot(), false).c_str());
+    }
+    return result;
+}
@@ -0,0 +1,96 @@
+// Converts a binary capture log to the CSV layout saved by the application, or to JSON for analysis scripts.
+#include "binarylog.h"
+#include "captureformat.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage() {
+    fprintf(stderr, "Usage: capgraph-logconv [options] <log.cglog>\n"
+                    "  --json                  Writes a JSON array instead of CSV\n"
+                    "  --delimiter <c>         CSV delimiter (default ,)\n"
+                    "  --output <file>         Writes to a file instead of the standard output\n");
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    std::string delimiter = ",";
+    std::string inputPath;
+    std::string outputPath;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (!strcmp(argv[i], "--delimiter") && hasValue) {
+            delimiter = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && hasValue) {
+            outputPath = argv[++i];
+        } else if (argv[i][0] != '-' && inputPath.empty()) {
+            inputPath = argv[i];
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (inputPath.empty()) {
+        printUsage();
+        return 2;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    auto reader = BinaryLogReader::Open(inputPath);
+    if (!reader) {
+        fprintf(stderr, "capgraph-logconv: can't read a capture log from %s\n", inputPath.c_str());
+        return 1;
+    }
+    if (!reader->IsComplete()) {
+        fprintf(stderr, "capgraph-logconv: %s was not closed, converting the complete blocks\n", inputPath.c_str());
+    }
+    std::ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile) {
+            fprintf(stderr, "capgraph-logconv: can't create %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
+    std::ostream& output = outputPath.empty() ? std::cout : outputFile;
+    if (json) {
+        output << "[";
+    } else {
+        writeCaptureHeader(output, delimiter);
+    }
+    std::vector<LogEntry> entries;
+    bool first = true;
+    for (size_t block = 0; block < reader->GetBlockCount(); block++) {
+        entries.clear();
+        if (!reader->ReadBlock(block, entries)) {
+            fprintf(stderr, "capgraph-logconv: block %zu of %s is corrupt\n", block, inputPath.c_str());
+            return 1;
+        }
+        for (const auto& entry : entries) {
+            if (json) {
+                output << (first ? "\n" : ",\n");
+                writeLogEntryJson(output, entry, reader->HasStats());
+                first = false;
+            } else {
+                CaptureItem item = {};
+                item.iTimestamp = entry.iTimestamp;
+                item.cAvgColor = entry.cAvgColor;
+                item.iRegion = entry.iRegion;
+                writeCaptureLine(output, item, delimiter);
+            }
+        }
+    }
+    if (json) {
+        output << "\n]\n";
+    }
+    output.flush();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%llu entries in %zu blocks, %.3f s\n", (unsigned long long)reader->GetEntryCount(), reader->GetBlockCount(),
+            seconds);
+    return 0;
+}
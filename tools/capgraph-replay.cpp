@@ -0,0 +1,146 @@
+// Replays a frame recording, raw or compressed, through the still image engine, as fast as the frames can be read, and
+// writes the items the live capture would have logged as CSV.
+#include "captureformat.h"
+#include "capturetelemetry.h"
+#include "framefile.h"
+#include "stillnessengine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage() {
+    fprintf(stderr, "Usage: capgraph-replay [options] <frames.cgrf>\n"
+                    "  --still-ms <ms>         Time an image must stay unchanged to be recorded (default 3000)\n"
+                    "  --threshold <mse>       Mean square error above which frames differ (default 0.01)\n"
+                    "  --sample-budget <n>     Pixels sampled per still image, 0 reads every pixel (default 0)\n"
+                    "  --delimiter <c>         CSV delimiter (default ,)\n"
+                    "  --signatures            Compares the frames with tile signatures instead of the previous frame\n"
+                    "  --sig-threshold <mse>   Threshold of the signature comparison (default 0.01)\n"
+                    "  --full-compare          Compares changed tiles at full resolution without the coarse level first\n"
+                    "  --first-frame <n>       Starts the replay at frame n\n"
+                    "  --save-frames <file>    Writes the frames replayed to a compressed recording\n"
+                    "  --telemetry             Prints the latencies of the engine stages when done\n"
+                    "  --output <file.csv>     Writes the items to a file instead of the standard output\n");
+}
+
+int main(int argc, char** argv) {
+    EngineSettings settings;
+    std::string delimiter = ",";
+    std::string inputPath;
+    std::string outputPath;
+    std::string savePath;
+    size_t firstFrame = 0;
+    bool withTelemetry = false;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--still-ms") && hasValue) {
+            settings.iStillDuration = atoll(argv[++i]) * FILE_TIME_TO_MILLISECONDS;
+        } else if (!strcmp(argv[i], "--threshold") && hasValue) {
+            settings.dChangeThreshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--sample-budget") && hasValue) {
+            settings.iSampleBudget = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--delimiter") && hasValue) {
+            delimiter = argv[++i];
+        } else if (!strcmp(argv[i], "--sig-threshold") && hasValue) {
+            settings.dSignatureThreshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--signatures")) {
+            settings.rmReference = ReferenceMode::TileSignatures;
+        } else if (!strcmp(argv[i], "--full-compare")) {
+            settings.bCoarseToFine = false;
+        } else if (!strcmp(argv[i], "--first-frame") && hasValue) {
+            firstFrame = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--save-frames") && hasValue) {
+            savePath = argv[++i];
+        } else if (!strcmp(argv[i], "--telemetry")) {
+            withTelemetry = true;
+        } else if (!strcmp(argv[i], "--output") && hasValue) {
+            outputPath = argv[++i];
+        } else if (argv[i][0] != '-' && inputPath.empty()) {
+            inputPath = argv[i];
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (inputPath.empty()) {
+        printUsage();
+        return 2;
+    }
+    auto reader = FrameFileReader::Open(inputPath);
+    if (!reader) {
+        fprintf(stderr, "capgraph-replay: can't read frames from %s\n", inputPath.c_str());
+        return 1;
+    }
+    if (!reader->SeekFrame(firstFrame)) {
+        fprintf(stderr, "capgraph-replay: %s has only %llu frames\n", inputPath.c_str(), (unsigned long long)reader->GetFrameCount());
+        return 1;
+    }
+    std::shared_ptr<FrameFileWriter> saver;
+    if (!savePath.empty()) {
+        saver = FrameFileWriter::Create(savePath, reader->GetWidth(), reader->GetHeight());
+        if (!saver) {
+            fprintf(stderr, "capgraph-replay: can't create %s\n", savePath.c_str());
+            return 1;
+        }
+    }
+    std::ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile) {
+            fprintf(stderr, "capgraph-replay: can't create %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
+    std::ostream& output = outputPath.empty() ? std::cout : outputFile;
+    writeCaptureHeader(output, delimiter);
+
+    // Two frame buffers used alternately, like the capture session does, or a single one with tile signatures
+    const int bufferCount = settings.rmReference == ReferenceMode::Frame ? 2 : 1;
+    std::vector<uint32_t> frames[2] = {std::vector<uint32_t>(reader->GetPixelCount()),
+                                       std::vector<uint32_t>(bufferCount > 1 ? reader->GetPixelCount() : 0)};
+    CaptureTelemetry telemetry;
+    if (withTelemetry) {
+        settings.pTelemetry = &telemetry;
+    }
+    StillnessEngine engine;
+    engine.Start();
+    uint64_t frameCount = 0;
+    uint64_t itemCount = 0;
+    int64_t timestamp;
+    const auto start = std::chrono::steady_clock::now();
+    while (reader->ReadFrame(frames[frameCount % bufferCount].data(), timestamp)) {
+        const uint32_t* frame = frames[frameCount % bufferCount].data();
+        const uint32_t* previous = frameCount && bufferCount > 1 ? frames[(frameCount - 1) % bufferCount].data() : nullptr;
+        if (saver) {
+            saver->WriteFrame(frame, timestamp);
+        }
+        if (engine.ProcessFrame(frame, previous, reader->GetWidth(), reader->GetHeight(), timestamp, settings) &&
+            engine.GetEvent().seType == StillnessEvent::StillImage) {
+            writeCaptureLine(output, engine.GetEvent().ciItem, delimiter);
+            itemCount++;
+        }
+        frameCount++;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%llu frames (%dx%d), %llu items, %.3f s, %.1f frames/s\n", (unsigned long long)frameCount, reader->GetWidth(),
+            reader->GetHeight(), (unsigned long long)itemCount, seconds, seconds > 0 ? frameCount / seconds : 0.0);
+    if (saver) {
+        const uint64_t rawBytes = frameCount * (sizeof(int64_t) + reader->GetPixelCount() * sizeof(uint32_t));
+        if (!saver->Close()) {
+            fprintf(stderr, "capgraph-replay: can't write %s\n", savePath.c_str());
+            return 1;
+        }
+        const uint64_t savedBytes = saver->GetSize();
+        fprintf(stderr, "%s: %llu bytes, %.1fx smaller than raw frames\n", savePath.c_str(), (unsigned long long)savedBytes,
+                savedBytes ? (double)rawBytes / savedBytes : 0.0);
+    }
+    if (withTelemetry) {
+        fprintf(stderr, "\n%s", formatTelemetryReport(telemetry.GetSnapshot(), false).c_str());
+    }
+    return 0;
+}
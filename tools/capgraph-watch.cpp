@@ -0,0 +1,91 @@
+// Follows the capture results published to a shared memory ring by a running capture, writing them as CSV, or as one
+// JSON object per line for dashboards, as they arrive.
+#include "captureformat.h"
+#include "sharedring.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static void printUsage() {
+    fprintf(stderr, "Usage: capgraph-watch [options] [ring name]\n"
+                    "  --from-oldest           Starts with the oldest entry still in the ring instead of the next one\n"
+                    "  --count <n>             Exits after n entries\n"
+                    "  --poll-ms <ms>          Wait between polls of an idle ring (default 50)\n"
+                    "  --json                  Writes one JSON object per line instead of CSV\n"
+                    "  --delimiter <c>         CSV delimiter (default ,)\n"
+                    "The ring name defaults to %s.\n",
+            DEFAULT_RING_NAME);
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    bool fromOldest = false;
+    std::string delimiter = ",";
+    std::string name;
+    uint64_t maxCount = 0;
+    int pollMs = 50;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (!strcmp(argv[i], "--from-oldest")) {
+            fromOldest = true;
+        } else if (!strcmp(argv[i], "--count") && hasValue) {
+            maxCount = (uint64_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--poll-ms") && hasValue) {
+            pollMs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--delimiter") && hasValue) {
+            delimiter = argv[++i];
+        } else if (argv[i][0] != '-' && name.empty()) {
+            name = argv[i];
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (name.empty()) {
+        name = DEFAULT_RING_NAME;
+    }
+    auto reader = SharedRingReader::Open(name, fromOldest);
+    if (!reader) {
+        fprintf(stderr, "capgraph-watch: no capture ring named %s\n", name.c_str());
+        return 1;
+    }
+    if (!json) {
+        writeCaptureHeader(std::cout, delimiter);
+        std::cout.flush();
+    }
+    uint64_t count = 0;
+    uint64_t lostCount = 0;
+    LogEntry entry;
+    while (!maxCount || count < maxCount) {
+        if (!reader->Read(entry)) {
+            // The ring has no way to wake readers, which keeps the writers from ever waiting on them
+            std::cout.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+            continue;
+        }
+        if (reader->GetLostCount() != lostCount) {
+            fprintf(stderr, "capgraph-watch: %llu entries overwritten before they were read\n",
+                    (unsigned long long)(reader->GetLostCount() - lostCount));
+            lostCount = reader->GetLostCount();
+        }
+        if (json) {
+            writeLogEntryJson(std::cout, entry, reader->HasStats());
+            std::cout << '\n';
+        } else {
+            CaptureItem item = {};
+            item.iTimestamp = entry.iTimestamp;
+            item.cAvgColor = entry.cAvgColor;
+            item.iRegion = entry.iRegion;
+            writeCaptureLine(std::cout, item, delimiter);
+        }
+        count++;
+    }
+    std::cout.flush();
+    return 0;
+}